@@ -56,14 +56,19 @@ DLLIMP SIT_Widget SIT_Init(int nvgFlags, int width, int height, STRPTR theme, in
 	sit.QPCfreqinv = 1000 / (double) sit.QPCfreq;
 	sit.QPCstart = start.QuadPart;
 
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	sit.cpuCount = MIN(info.dwNumberOfProcessors, 255);
+
 	sit.nvgCtx = nvgCreateGL3(nvgFlags);
-	sit.lastRule = -1;
 	sit.scrWidth = width;
 	sit.scrHeight = height;
 	sit.nextAction = INFINITY;
 	sit.dblClickMS = GetDoubleClickTime();
 	sit.caretBlinkMS = GetCaretBlinkTime();
 	sit.fontScale = 1;
+	sit.measureGen = 1;
+	sit.drawGen = 1;
 
 	if (! sit.nvgCtx)
 	{
@@ -469,7 +474,7 @@ DLLIMP void SIT_ForceRefresh(void)
 
 DLLIMP int SIT_NeedRefresh(void)
 {
-	return sit.dirty;
+	return sit.dirty || sit.damage[0] < sit.damage[2];
 }
 
 DLLIMP SIT_Widget SIT_GetFocus(void)
@@ -551,8 +556,11 @@ DLLIMP void SIT_Nuke(int what)
 		SIT_FreeImg(NULL, NULL, NULL);
 		free(sit.cssFile); sit.cssFile = NULL;
 		free(sit.theme);   sit.theme   = NULL;
+		sit.themeSize = 0;
 		sit.themeMax = 0;
-		sit.lastRule = -1;
+		cssFreeIndex();
+		cssFreeOldThemes();
+		renderFreeShapes();
 		SIT_DebugMalloc(1);
 	}
 }
@@ -586,7 +594,8 @@ void SIT_NukeCSS(void)
 	free(sit.theme);   sit.theme   = NULL;
 	sit.themeSize = 0;
 	sit.themeMax = 0;
-	sit.lastRule = -1;
+	cssFreeIndex();
+	cssFreeOldThemes();
 }
 
 /* utility function */
@@ -849,6 +858,9 @@ PFNGLUSEPROGRAMPROC glad_glUseProgram;
 PFNGLACTIVETEXTUREPROC glad_glActiveTexture;
 PFNGLBINDBUFFERPROC glad_glBindBuffer;
 PFNGLBUFFERDATAPROC glad_glBufferData;
+PFNGLBUFFERSUBDATAPROC glad_glBufferSubData;
+PFNGLMAPBUFFERRANGEPROC glad_glMapBufferRange;
+PFNGLUNMAPBUFFERPROC glad_glUnmapBuffer;
 PFNGLBINDVERTEXARRAYPROC glad_glBindVertexArray;
 PFNGLENABLEVERTEXATTRIBARRAYPROC glad_glEnableVertexAttribArray;
 PFNGLVERTEXATTRIBPOINTERPROC glad_glVertexAttribPointer;
@@ -865,6 +877,7 @@ PFNGLSTENCILFUNCPROC glad_glStencilFunc;
 PFNGLDELETETEXTURESPROC glad_glDeleteTextures;
 PFNGLGETERRORPROC glad_glGetError;
 PFNGLGETINTEGERVPROC glad_glGetIntegerv;
+PFNGLGETFLOATVPROC glad_glGetFloatv;
 PFNGLFINISHPROC glad_glFinish;
 PFNGLGENTEXTURESPROC glad_glGenTextures;
 PFNGLPIXELSTOREIPROC glad_glPixelStorei;
@@ -879,6 +892,7 @@ PFNGLSTENCILOPPROC glad_glStencilOp;
 PFNGLCULLFACEPROC glad_glCullFace;
 PFNGLFRONTFACEPROC glad_glFrontFace;
 PFNGLVIEWPORTPROC glad_glViewport;
+PFNGLSCISSORPROC glad_glScissor;
 PFNGLCLEARCOLORPROC glad_glClearColor;
 PFNGLCLEARPROC glad_glClear;
 
@@ -946,6 +960,9 @@ int gladLoadGL(void)
 		 && (glad_glActiveTexture      = load(name = "glActiveTexture"))
 		 && (glad_glBindBuffer         = load(name = "glBindBuffer"))
 		 && (glad_glBufferData         = load(name = "glBufferData"))
+		 && (glad_glBufferSubData      = load(name = "glBufferSubData"))
+		 && (glad_glMapBufferRange     = load(name = "glMapBufferRange"))
+		 && (glad_glUnmapBuffer        = load(name = "glUnmapBuffer"))
 		 && (glad_glBindVertexArray    = load(name = "glBindVertexArray"))
 		 && (glad_glUniform1i          = load(name = "glUniform1i"))
 		 && (glad_glUniform2fv         = load(name = "glUniform2fv"))
@@ -958,6 +975,7 @@ int gladLoadGL(void)
 		 && (glad_glDeleteTextures     = load(name = "glDeleteTextures"))
 		 && (glad_glGetError           = load(name = "glGetError"))
 		 && (glad_glGetIntegerv        = load(name = "glGetIntegerv"))
+		 && (glad_glGetFloatv          = load(name = "glGetFloatv"))
 		 && (glad_glFinish             = load(name = "glFinish"))
 		 && (glad_glGenTextures        = load(name = "glGenTextures"))
 		 && (glad_glPixelStorei        = load(name = "glPixelStorei"))
@@ -972,6 +990,7 @@ int gladLoadGL(void)
 		 && (glad_glCullFace           = load(name = "glCullFace"))
 		 && (glad_glFrontFace          = load(name = "glFrontFace"))
 		 && (glad_glViewport           = load(name = "glViewport"))
+		 && (glad_glScissor            = load(name = "glScissor"))
 		 && (glad_glClearColor         = load(name = "glClearColor"))
 		 && (glad_glClear              = load(name = "glClear"))
 		 && (glad_glGetTexLevelParameteriv   = load(name = "glGetTexLevelParameteriv"))
@@ -99,11 +99,14 @@ DLLIMP void       SIT_DelCallback(SIT_Widget, int type, SIT_CallProc, APTR data)
 DLLIMP int        SIT_ApplyCallback(SIT_Widget, APTR cd, int type);
 DLLIMP void       SIT_SetValues(SIT_Widget, ...) SIT_SENTINEL;
 DLLIMP void       SIT_GetValues(SIT_Widget, ...) SIT_SENTINEL;
+DLLIMP void       SIT_BeginUpdate(void);
+DLLIMP void       SIT_EndUpdate(void);
 DLLIMP void       SIT_SetAttributes(SIT_Widget parent, STRPTR fmt, ...);
 DLLIMP void       SIT_SetFocus(SIT_Widget);
 DLLIMP void       SIT_CloseDialog(SIT_Widget);
 DLLIMP void       SIT_MoveNearby(SIT_Widget, int XYWH[4], int defAlign);
 DLLIMP void       SIT_ForceRefresh(void);
+DLLIMP void       SIT_RefreshWidget(SIT_Widget);
 DLLIMP int        SIT_NeedRefresh(void);
 DLLIMP int        SIT_InitDrag(SIT_CallProc);
 DLLIMP Bool       SIT_ParseCSSColor(STRPTR cssColor, uint8_t ret[4]);
@@ -243,6 +246,7 @@ enum
 	SIT_MinHeight        = 51,   /* CSGR: Int (unit) */
 	SIT_MaxBoxWidth      = 52,   /* CSGR: Int (unit) */
 	SIT_MaxBoxHeight     = 53,   /* CSGR: Int (unit) */
+	SIT_Layer            = 142,  /* _SG_: Bool (not a common tag: after SIT_EndCommonTags) */
 
 	/* App */
 	SIT_DefRoundTo       = 54,   /* _SG: Int */
@@ -260,6 +264,8 @@ enum
 	SIT_StyleSheet       = 66,   /* _S_: String */
 	SIT_CompositedAreas  = 67,   /* __G: DATA8 */
 	SIT_FontScale        = 68,   /* _SG: Int (percentage) */
+	SIT_LayoutCount      = 140,  /* __G: Int */
+	SIT_RedrawArea       = 141,  /* __G: int * (4 values) */
 
 	/* Dialog tags */
 	SIT_DialogStyles     = 69,   /* C__: Bitfield */
@@ -376,7 +382,8 @@ enum
 enum         /* SIT_RefreshMode */
 {
 	SITV_RefreshAlways,          /* default: redraw interface at each frame */
-	SITV_RefreshAsNeeded         /* only when something has changed */
+	SITV_RefreshAsNeeded,        /* only when something has changed */
+	SITV_RefreshDamaged          /* only redraw areas that have changed (back buffer must be preserved) */
 };
 
 enum         /* SIT_Overflow */
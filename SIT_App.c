@@ -30,6 +30,8 @@
 		{ NULL, SIT_SetAppIcon,      _S_, SIT_INT,  0 },
 		{ NULL, SIT_CompositedAreas, __G, SIT_PTR,  0 },
 		{ NULL, SIT_FontScale,       _SG, SIT_INT,  0 },
+		{ NULL, SIT_LayoutCount,     __G, SIT_INT,  0 },
+		{ NULL, SIT_RedrawArea,      __G, SIT_PTR,  0 },
 		{ NULL, SIT_TagEnd }
 	};
 	static WNDPROC mainWndProc;
@@ -159,6 +161,10 @@ static STRPTR SIT_GetFontFile(STRPTR fmt, STRPTR dest)
 void SIT_ChangeChildrenStyle(SIT_Widget root, int flags)
 {
 	SIT_Widget list;
+	cssShareStyles(True);
+	if (flags & 1)
+		/* all styles will be reapplied */
+		cssResolveTree(root);
 	for (list = root; ; )
 	{
 		layoutClearStyles(list, flags);
@@ -187,6 +193,7 @@ void SIT_ChangeChildrenStyle(SIT_Widget root, int flags)
 
 	/* need to compute CSS box first */
 	layout:
+	cssShareStyles(False);
 	for (list = root; ; )
 	{
 		if (list->flags & SITF_TopLevel)
@@ -206,9 +213,55 @@ void SIT_ChangeChildrenStyle(SIT_Widget root, int flags)
 	}
 }
 
+/* clear styles of widgets that can be affected by modified rules: returns True if some need a reflow */
+static Bool SIT_ClearChangedStyles(SIT_Widget w, Bool clear, int flags)
+{
+	SIT_Widget c;
+	Bool       reflow;
+
+	/* inherited styles might change too */
+	if (! clear) clear = cssRulesChanged(w);
+	if (clear) cssClear(w);
+
+	for (c = HEAD(w->children), reflow = clear; c; NEXT(c))
+		reflow |= SIT_ClearChangedStyles(c, clear, flags);
+
+	if (reflow && (w->flags & SITF_TopLevel))
+	{
+		/* only restyle/reflow dialogs that need it */
+		SIT_ChangeChildrenStyle(w, flags);
+		return False;
+	}
+	return reflow;
+}
+
+/* stylesheet has been modified: only restyle what has changed */
+static Bool SIT_ReloadStyleSheet(STRPTR path, int flags)
+{
+	CSSTheme old = cssSaveTheme();
+
+	if (cssParse(path, True))
+	{
+		int diff = cssDiffTheme(old);
+		cssFreeTheme(old);
+		sit.geomList = NULL;
+		switch (diff) {
+		case 0: break;
+		case 1: SIT_ClearChangedStyles(sit.root, False, flags); sit.dirty = 1; break;
+		case 2: return False;
+		}
+		return True;
+	}
+	cssFreeTheme(old);
+	return False;
+}
+
 /* replace the entire stylesheet */
 void SIT_ChangeStyleSheet(STRPTR path, int mode)
 {
+	if (path && sit.theme && SIT_ReloadStyleSheet(path, mode == FitUsingInitialBox ? 2 : 0))
+		return;
+
 	if (path)
 	{
 		SIT_NukeCSS();
@@ -221,6 +274,8 @@ void SIT_ChangeStyleSheet(STRPTR path, int mode)
 
 	/* reapply new styles to all widgets */
 	sit.geomList = NULL;
+	sit.measureGen ++;
+	sit.drawGen ++;
 	int flags = 0;
 	if (path != NULL) flags |= 1;
 	if (mode == FitUsingInitialBox) flags |= 2;
@@ -15,6 +15,9 @@
 
 vector_t cssStyles;
 
+static void cssFreeResolved(void);
+static void cssStopWorkers(void);
+
 struct CSSAttr_t /* keep it private */
 {
 	STRPTR   attr;
@@ -244,9 +247,26 @@ uint32_t crc32(uint32_t crc, DATA8 buf, int max)
 	return crc ^ 0xffffffffL;
 }
 
+/* compiled stylesheet cache stores index in cssattrs[]: identify table content and order */
+uint32_t cssAttrsCRC(void)
+{
+	uint32_t crc;
+	int      i;
+	for (i = 0, crc = 0; i < DIM(cssattrs); i ++)
+	{
+		CSSAttr css = cssattrs + i;
+		crc = crc32(crc, css->attr   ? css->attr   : "", -1);
+		crc = crc32(crc, css->format ? css->format : "", -1);
+	}
+	return crc;
+}
+
 void cssFreeGlobals(void)
 {
+	cssShareStyles(False);
+	cssStopWorkers();
 	vector_free(cssStyles);
+	cssFreeAtoms();
 }
 
 DLLIMP Bool SIT_GetCSSValue(SIT_Widget w, STRPTR property, APTR mem)
@@ -304,7 +324,7 @@ DLLIMP Bool SIT_GetCSSValue(SIT_Widget w, STRPTR property, APTR mem)
 	return False;
 }
 
-/* CSS class selector match */
+/* CSS attribute list selector match */
 static Bool cssMatchList(STRPTR list, STRPTR item)
 {
 	STRPTR p, prev;
@@ -329,6 +349,20 @@ static Bool cssMatchList(STRPTR list, STRPTR item)
  * that is used to apply CSS rules to DOMNode. Current complexity of this
  * function sucks (O(NbRules*NbNodes)), could be O(RulesDepth*NbNodes)
  */
+/*
+ * tagName can be changed by widget constructor: atoms are lazily updated by the caller, matching must not
+ * write anything (done from worker threads). Nodes reachable: ancestors and their previous sibling.
+ */
+static void cssSetMatchAtoms(SIT_Widget node)
+{
+	for (; node; node = node->parent)
+	{
+		SIT_Widget prev = (SIT_Widget) node->node.ln_Prev;
+		if (node->atomTag != node->tagName) cssSetAtoms(node);
+		if (prev && prev->atomTag != prev->tagName) cssSetAtoms(prev);
+	}
+}
+
 static Bool cssMatchSelector(SIT_Widget * stack, int level, CSSRule rule)
 {
 	SIT_Widget node;
@@ -354,10 +388,11 @@ static Bool cssMatchSelector(SIT_Widget * stack, int level, CSSRule rule)
 				// fprintf(stderr, "invalid 'NONE' transition for rule.\n");
 				break;
 			case CSSR_TAG:
-				match = strcmp(s->item, "*") == 0 || strcasecmp(node->tagName, s->item) == 0;
+				match = s->atom == 0 || s->atom == node->tagAtom;
 				break;
 			case CSSR_PSEUDO:
-				switch (FindInList("link,active,hover,focus,kbdfocus,checked,disabled", s->item, 0)) {
+				/* see CSS_PSEUDOCLASSES */
+				switch (s->atom - 1) {
 				case 0: /* link */
 					attr  = SIT_GetHTMLAttr(node, "href");
 					match = strcmp(node->tagName, "a") == 0 && IsDef(attr);
@@ -396,10 +431,15 @@ static Bool cssMatchSelector(SIT_Widget * stack, int level, CSSRule rule)
 				else match = cssMatchList(attr, arg);
 				break;
 			case CSSR_CLASS:
-				match = node->classes && cssMatchList(node->classes, s->item);
+				if (node->classAtoms)
+				{
+					DATA16 atom;
+					for (atom = node->classAtoms; *atom && *atom < s->atom; atom ++);
+					match = *atom == s->atom;
+				}
 				break;
 			case CSSR_ID:
-				match = strcasecmp(node->name, s->item) == 0;
+				match = s->atom == node->idAtom;
 			}
 
 			if (match)
@@ -545,7 +585,7 @@ static void cssMultAssign(CSSAttr attr, APTR mem)
 	}
 }
 
-static void cssApplyAttribute(SIT_Widget, STRPTR attr, STRPTR value);
+static void cssApplyAttribute(SIT_Widget, CSSAttr a, STRPTR value, CSSDecl decl);
 
 /* handle multiple background, image, color, box-shadow, text-shadow ... */
 typedef struct MultiLayer_t *      MultiLayer;
@@ -1014,20 +1054,108 @@ static Bool cssApplyMultipleParam(SIT_Widget node, CSSAttr a, STRPTR value)
 		value[i] = '/';
 		memcpy(value + i + 1, lineHeight, linePos >> 16);
 		/* need to apply line-height separately */
-		cssApplyAttribute(node, "line-height", lineHeight);
+		cssApplyAttribute(node, GET(cssAttrLineHeight), lineHeight, NULL);
 	}
 
 	return True;
 }
 
+/*
+ * precompile declaration when stylesheet is loaded: resolve property name and parse single
+ * parameter values that do not depend on node they will be applied to. Anything else will
+ * be parsed by cssApplyAttribute().
+ */
+void cssCompileDecl(CSSDecl decl)
+{
+	CSSAttr a     = cssAttrSearch(decl->attr);
+	STRPTR  value = decl->value;
+	STRPTR  p     = strchr(value, '!');
+	CSSArg  arg   = {.type = CSSArg_NotSet};
+	Bool    ok    = False;
+
+	decl->index = a ? a - cssattrs : -1;
+	decl->size  = 0;
+
+	if (p)
+	{
+		/* anything other than "important" must discard the entire declaration */
+		if (strcasecmp(skipspace(p+1), "important"))
+		{
+			decl->index = -1;
+			return;
+		}
+		decl->flags |= CSSD_IMPORTANT;
+		if (p > value && p[-1] == ' ') p --;
+		*p = 0;
+	}
+
+	/* multiple parameters, special processing or explicit inherit: will be done at runtime */
+	if (a == NULL || ! IsDef(a->format) || a->objtype > 0 || strchr(a->format, ' ') ||
+	    a == GET(cssAttrLineHeight) || a == GET(cssAttrBorderRadius) || a == GET(cssAttrBackground) ||
+	    strcasecmp(value, "inherit") == 0 || strcasecmp(value, "initial") == 0)
+		return;
+
+	p = a->format;
+	if (*p == '|')
+	{
+		cssFindInList(p + 1, value, &arg, True);
+		switch (arg.type) {
+		case CSSArg_U32:
+			if (a->sz == 1) decl->val.u8 = arg.val.u32 > 255 ? 255 : arg.val.u32, decl->size = 1;
+			else decl->val.u32 = arg.val.u32, decl->size = sizeof decl->val.u32;
+			break;
+		case CSSArg_Str:
+			decl->val.str = arg.val.str;
+			decl->size    = sizeof decl->val.str;
+			decl->flags  |= CSSD_POINTER;
+			break;
+		case CSSArg_Color:
+			decl->val.col = arg.val.col;
+			decl->size    = sizeof decl->val.col;
+		default: break;
+		}
+	}
+	else switch (FindInList("COLOR,POS,URI,STR,INT,DBL", p, 0)) {
+	case 0:
+		ok = cssParseColor(&value, &decl->val.col);
+		decl->size = sizeof decl->val.col;
+		break;
+	case 1:
+		ok = cssParsePos(&value, &decl->val.u32, 1);
+		decl->size = sizeof decl->val.u32;
+		break;
+	case 2:
+		ok = cssParseURI(value, &value, &decl->val.str);
+		decl->size = sizeof decl->val.str;
+		decl->flags |= CSSD_POINTER;
+		break;
+	case 3:
+		ok = True;
+		decl->val.str = value;
+		decl->size = sizeof decl->val.str;
+		decl->flags |= CSSD_POINTER;
+		break;
+	case 4:
+		if (a->sz != 1 && a->sz != 4) break;
+		ok = cssParseNum(&value, &decl->val, a->sz);
+		decl->size = a->sz == 1 ? 1 : sizeof decl->val.u32;
+		break;
+	case 5:
+		ok = cssParseNum(&value, &decl->val.real, 2);
+		decl->size = sizeof decl->val.real;
+	}
+	/* invalid value: let cssApplyAttribute() deal with it */
+	if (! ok && arg.type == CSSArg_NotSet)
+		decl->size = 0, decl->flags &= ~CSSD_POINTER;
+}
+
 /*
  * Apply CSS attribute and store it into our style struct. This is the core
- * function that transfert CSS values into DOMNode. This function is close
- * to optimal complexity.
+ * function that transfert CSS values into DOMNode. Values precompiled by
+ * cssCompileDecl() (<decl> not NULL) only need to be copied.
  */
-static void cssApplyAttribute(SIT_Widget node, STRPTR attr, STRPTR value)
+static void cssApplyAttribute(SIT_Widget node, CSSAttr a, STRPTR value, CSSDecl decl)
 {
-	CSSAttr a   = cssAttrSearch(attr);
 	int     arg = 0;
 	int     nbc = 0;
 	int     radiusMinor = 0;
@@ -1039,6 +1167,18 @@ static void cssApplyAttribute(SIT_Widget node, STRPTR attr, STRPTR value)
 	if ((a->inherit&3) && (nbc = a->inherit>>2))
 		node->style.inheritSet |= 1 << nbc;
 
+	if (a == GET(cssAttrBorderSpacing) && node->type != SIT_LISTBOX)
+		return;
+
+	if (a == GET(cssAttrCaret) && node->type != SIT_EDITBOX)
+		return;
+
+	if (decl && decl->size > 0)
+	{
+		memcpy((STRPTR) node + a->arg1, &decl->val, decl->size);
+		goto post_process;
+	}
+
 	/* multiple parameter attributes will be handled differently than single parameter attributes */
 	for (nbc = 1, p = a->format; *p; nbc += *p == ' ', p ++);
 
@@ -1052,12 +1192,6 @@ static void cssApplyAttribute(SIT_Widget node, STRPTR attr, STRPTR value)
 		}
 	}
 
-	if (a == GET(cssAttrBorderSpacing) && node->type != SIT_LISTBOX)
-		return;
-
-	if (a == GET(cssAttrCaret) && node->type != SIT_EDITBOX)
-		return;
-
 	if (a == GET(cssAttrBackground) && strcasecmp(value, "none") == 0)
 	{
 		/* "background: none" is translated into "transparent none" to be sure background-color is also reset */
@@ -1077,7 +1211,7 @@ static void cssApplyAttribute(SIT_Widget node, STRPTR attr, STRPTR value)
 			CopyString(dup, value, arg);
 			value = dup;
 			for (p ++; *p && cssIsSpace(*p); p ++);
-			if (*p) cssApplyAttribute(node, "border-radius-minor", p), radiusMinor = 0;
+			if (*p) cssApplyAttribute(node, cssAttrSearch("border-radius-minor"), p, NULL), radiusMinor = 0;
 		}
 	}
 
@@ -1164,6 +1298,7 @@ static void cssApplyAttribute(SIT_Widget node, STRPTR attr, STRPTR value)
 	}
 
 	/* some attribute need special processing */
+	post_process:
 	if (a == GET(cssAttrBorder))
 	{
 		/* copy attributes styles to right, left and bottom */
@@ -1269,34 +1404,20 @@ void cssSetDefault(SIT_Widget node)
  * we need to gather all styles inside a list before applying them, because
  * they are not completely sorted yet (!important not taken into account yet)
  */
-static void cssAddStyles(vector v, STRPTR * styles, int count, int specif, int specif_important)
+static void cssAddStyles(vector v, CSSDecl decl, int count, int specif, int specif_important)
 {
-	static int i = 0; /* used to sort rules with same specif: last declared takes precedence over first */
-	while (count > 0 && styles[0])
+	/* order is used to sort rules with same specif: last declared takes precedence over first */
+	int i = v->count;
+	for (; count > 0 && decl->attr; count --, decl ++)
 	{
-		/* filter !important rules */
-		STRPTR sep = strchr(styles[1], '!');
-
-		if (sep)
-		{
-			/* anything other than "important" must discard the entire declaration */
-			if (strcasecmp(skipspace(sep+1), "important"))
-			{
-				styles += 2;
-				count  --;
-				continue;
-			}
-			specif += specif_important << 24;
-		}
+		/* unsupported property or bogus !important */
+		if (decl->index < 0) continue;
 
 		CSSStyle style = vector_nth(v, v->count);
 
-		style->specif = specif;
-		style->attr   = styles[0];
-		style->value  = styles[1];
+		style->specif = decl->flags & CSSD_IMPORTANT ? specif + (specif_important << 24) : specif;
+		style->decl   = decl;
 		style->order  = i ++;
-		styles += 2;
-		count  --;
 	}
 }
 
@@ -1391,16 +1512,11 @@ static int cssCheckChange(SIT_Widget node, Style * old, CSSAttr a)
 	return ret;
 }
 
-static uint32_t cssCRC32(vector styles)
+/* styles applied to a node are entirely defined by the rules it matched (in declaration order) */
+static uint64_t cssFingerprint(uint64_t hash, uint64_t value)
 {
-	CSSStyle style;
-	uint32_t crc = 0, i;
-
-	for (i = styles->count, style = vector_first(*styles); i > 0; i --, style ++)
-	{
-		crc = crc32(crc32(crc, style->attr, -1), style->value, -1);
-	}
-	return crc;
+	hash = (hash ^ value) * 0x9E3779B97F4A7C15ULL;
+	return hash ^ (hash >> 29);
 }
 
 /* css checksum not changed, but styles can still be changed due to inheritance */
@@ -1435,29 +1551,415 @@ static int cssGetInherited(SIT_Widget node)
 	return ret;
 }
 
+/* rules that can match a node are scattered in several buckets: get next one in declaration order */
+static int cssNextCandidate(vector * buckets, int * cursor, int count, int last)
+{
+	int i, min;
+	for (i = 0, min = -1; i < count; i ++)
+	{
+		vector v = buckets[i];
+		int *  rules = vector_first(*v);
+		int    pos = cursor[i];
+
+		/* hash collisions can put the same bucket several times in the list */
+		while (pos < v->count && rules[pos] <= last) pos ++;
+		if (pos < v->count && (min < 0 || rules[pos] < min))
+			min = rules[pos];
+		cursor[i] = pos;
+	}
+	return min;
+}
+
+/* bloom filter of ancestors atoms: 2 bits per atom */
+#define	BLOOM_BIT1(atom)        (((atom) * 2654435761u) >> 24)
+#define	BLOOM_BIT2(atom)        (((atom) * 2654435761u >> 16) & (CSS_BLOOMSZ - 1))
+#define	BLOOM_SET(bloom, bit)   (bloom)[(bit) >> 5] |= 1u << ((bit) & 31)
+#define	BLOOM_TEST(bloom, bit)  ((bloom)[(bit) >> 5] & (1u << ((bit) & 31)))
+
+static void cssBloomAdd(uint32_t * bloom, int atom)
+{
+	BLOOM_SET(bloom, BLOOM_BIT1(atom));
+	BLOOM_SET(bloom, BLOOM_BIT2(atom));
+}
+
+/* check if items of rule that must be found in ancestors are present: False means definitely not */
+static Bool cssBloomMatch(uint32_t * bloom, CSSRule rule)
+{
+	int i;
+	for (i = 0; i < CSS_MAXANCESTORS && rule->ancestors[i]; i ++)
+	{
+		int atom = rule->ancestors[i];
+		if (! BLOOM_TEST(bloom, BLOOM_BIT1(atom)) || ! BLOOM_TEST(bloom, BLOOM_BIT2(atom)))
+			return False;
+	}
+	return True;
+}
+
+/* get buckets of rules whose rightmost compound selector might match <node> (NULL: only count them) */
+static int cssGetBuckets(SIT_Widget node, vector * buckets)
+{
+	DATA16 atom;
+	int    count = 3;
+
+	if (buckets)
+	{
+		buckets[0] = cssIndexBucket(CSSR_NONE, 0);
+		buckets[1] = cssIndexBucket(CSSR_TAG, node->tagAtom);
+		buckets[2] = cssIndexBucket(CSSR_ID,  node->idAtom);
+	}
+	for (atom = node->classAtoms; atom && *atom; atom ++, count ++)
+		if (buckets) buckets[count] = cssIndexBucket(CSSR_CLASS, *atom);
+
+	return count;
+}
+
 /*
- * cssApply: apply CSS styles to given SIT_Widget. This is a O(MxN) algorithm, not
- * the most efficient (where M = number of nodes, and N = number of rules).
- * Ideally, it can be done in O(MxD), where D = depth of the longest CSS selector.
- *
- * XXX don't really care, we can cache the result of this function :-/
+ * style sharing: when restyling a whole tree, siblings with same tag, classes and state will
+ * match the exact same rules: keep the last few results, to skip rule matching entirely.
+ */
+#define	CSS_SHARESZ      8
+#define	CSS_SHARECLASS   8
+
+typedef struct CSSShare_t *     CSSShare;
+
+struct CSSShare_t
+{
+	SIT_Widget parent;
+	uint16_t   tagAtom, idAtom;
+	uint16_t   classAtoms[CSS_SHARECLASS]; /* 0-terminated */
+	uint8_t    state, enabled;
+	uint8_t    stateDeps;
+	uint64_t   fingerprint;                /* of matched rules */
+	vector_t   styles;                     /* CSSStyle, sorted */
+};
+
+static struct CSSShare_t cssShare[CSS_SHARESZ];
+static int cssShareNext, cssShareEnabled;
+
+/* SIT_ChangeChildrenStyle(): widget states will not change while styles are being reapplied */
+void cssShareStyles(Bool enable)
+{
+	if (enable) { cssShareEnabled ++; return; }
+	if (cssShareEnabled > 0 && -- cssShareEnabled > 0) return;
+
+	cssFreeResolved();
+
+	CSSShare share;
+	for (share = cssShare; share < EOT(cssShare); share ++)
+	{
+		vector_free(share->styles);
+		memset(share, 0, sizeof *share);
+	}
+	cssShareNext = 0;
+}
+
+/* fill key of sharing cache: False if node can't share its styles */
+static Bool cssShareKey(SIT_Widget node, CSSShare key)
+{
+	int i;
+	if (cssShareEnabled == 0 || node->inlineStyles || node->parent == NULL)
+		return False;
+
+	for (i = 0; node->classAtoms && node->classAtoms[i]; i ++)
+	{
+		if (i == CSS_SHARECLASS - 1) return False;
+		key->classAtoms[i] = node->classAtoms[i];
+	}
+	key->classAtoms[i] = 0;
+	key->parent  = node->parent;
+	key->tagAtom = node->tagAtom;
+	key->state   = node->state;
+	key->enabled = node->enabled;
+	/* ids are unique, but most of them are not referenced in the stylesheet */
+	key->idAtom  = node->idAtom && cssIndexBucket(CSSR_ID, node->idAtom)->count > 0 ? node->idAtom : 0;
+	return True;
+}
+
+static CSSShare cssShareFind(CSSShare key)
+{
+	CSSShare share;
+	for (share = cssShare; share < EOT(cssShare); share ++)
+	{
+		if (share->parent == key->parent && share->tagAtom == key->tagAtom && share->idAtom == key->idAtom &&
+		    share->state == key->state && share->enabled == key->enabled &&
+		    memcmp(share->classAtoms, key->classAtoms, sizeof key->classAtoms) == 0)
+			return share;
+	}
+	return NULL;
+}
+
+static void cssShareAdd(CSSShare key, vector styles, int stateDeps, uint64_t fingerprint)
+{
+	CSSShare share = cssShare + cssShareNext;
+	vector_t old = share->styles;
+
+	cssShareNext = (cssShareNext + 1) % CSS_SHARESZ;
+	memcpy(share, key, offsetof(struct CSSShare_t, styles));
+	share->stateDeps = stateDeps;
+	share->fingerprint = fingerprint;
+	share->styles = old;
+	share->styles.itemsize = styles->itemsize;
+	share->styles.count = 0;
+	if (styles->count > 0)
+	{
+		vector_nth(&share->styles, styles->count - 1);
+		memcpy(share->styles.buffer, styles->buffer, styles->count * styles->itemsize);
+	}
+}
+
+/*
+ * style resolution: get the sorted list of declarations that apply to <node>. It does not modify
+ * anything global, so it can be run from several threads at once (see cssResolveTree()), as long
+ * as atoms of node and its ancestors are up to date. Returns flags of all candidate rules.
+ */
+static int cssResolve(SIT_Widget node, vector styles, uint64_t * fingerprint, uint8_t * stateDeps, Bool threaded)
+{
+	SIT_Widget * stack;
+	SIT_Widget   parent;
+	CSSRule      rule;
+	vector *     buckets;
+	int *        cursor;
+	uint32_t     bloom[CSS_BLOOMSZ/32];
+	uint64_t     hash;
+	int          i, nb, level, flags;
+
+	memset(bloom, 0, sizeof bloom);
+	for (level = 0, parent = node; parent; level ++, parent = parent->parent);
+	stack = alloca(sizeof *stack * level);
+	for (i = level-1, parent = node; parent; stack[i] = parent, i --, parent = parent->parent)
+	{
+		DATA16 atom;
+		if (parent == node) continue;
+		cssBloomAdd(bloom, parent->tagAtom);
+		if (parent->idAtom) cssBloomAdd(bloom, parent->idAtom);
+		for (atom = parent->classAtoms; atom && *atom; cssBloomAdd(bloom, *atom), atom ++);
+	}
+
+	/* only test candidate rules, in the order they were declared */
+	nb = cssGetBuckets(node, NULL);
+	buckets = alloca(nb * (sizeof *buckets + sizeof *cursor));
+	cursor  = (int *) (buckets + nb);
+	cssGetBuckets(node, buckets);
+	memset(cursor, 0, nb * sizeof *cursor);
+	styles->count = 0;
+	hash  = 0xcbf29ce484222325ULL;
+	flags = 0;
+	*stateDeps = 0;
+
+	for (i = -1; (i = cssNextCandidate(buckets, cursor, nb, i)) >= 0; )
+	{
+		rule = (CSSRule) (sit.theme + i);
+		/* :link will modify the node it matches */
+		if (threaded && (rule->flags & CSSRF_LINK)) return -1;
+		*stateDeps |= rule->states;
+		flags |= rule->flags;
+		if (cssBloomMatch(bloom, rule) && cssMatchSelector(stack, level, rule))
+		{
+			cssAddStyles(styles, (CSSDecl) (sit.theme + rule->styles), rule->nbstyles, rule->specif, 1);
+			hash = cssFingerprint(hash, i);
+		}
+	}
+
+	if (node->inlineStyles)
+	{
+		cssAddStyles(styles, node->inlineStyles, 1e6, 0xff<<16, 2);
+		hash = cssFingerprint(hash, (size_t) node->inlineStyles);
+	}
+
+	qsort(styles->buffer, styles->count, sizeof (struct CSSStyle_t), cssSortStyle);
+	*fingerprint = hash;
+	return flags;
+}
+
+/*
+ * parallel restyle: when the whole stylesheet is reapplied to a large tree, style resolution of
+ * every node is done on a worker pool first. cssApply() will then only have to apply the result,
+ * which has to be done on the main thread (image loading, font handles, ...).
+ */
+#define	CSS_PARALLELMIN  512   /* not worth it below this number of nodes */
+#define	CSS_MAXTHREADS   16
+#define	CSS_CHUNK        64    /* nodes processed by a thread in one go */
+
+typedef struct CSSResolved_t *  CSSResolved;
+
+struct CSSResolved_t
+{
+	SIT_Widget node;
+	vector_t   styles;         /* CSSStyle, sorted */
+	uint64_t   fingerprint;
+	uint8_t    stateDeps;
+	int8_t     flags;          /* -1 if not resolved */
+};
+
+static struct
+{
+	Semaphore   start, done;
+	Mutex       lock;
+	int         threads;       /* workers, not counting main thread */
+	int         next, count;   /* nodes being processed */
+	int         quit;
+	int *       hash;          /* node -> index in <nodes> + 1 */
+	int         hashSize;
+	CSSResolved nodes;
+}	cssPool;
+
+static void cssResolveChunks(void)
+{
+	for (;;)
+	{
+		CSSResolved res;
+		int         i, end;
+
+		MutexEnter(cssPool.lock);
+		i = cssPool.next;
+		cssPool.next += CSS_CHUNK;
+		MutexLeave(cssPool.lock);
+		if (i >= cssPool.count) break;
+
+		for (end = MIN(i + CSS_CHUNK, cssPool.count), res = cssPool.nodes + i; i < end; i ++, res ++)
+		{
+			vector_init(res->styles, sizeof (struct CSSStyle_t));
+			res->flags = cssResolve(res->node, &res->styles, &res->fingerprint, &res->stateDeps, True);
+		}
+	}
+}
+
+static void cssResolveWorker(APTR unused)
+{
+	for (;;)
+	{
+		SemWait(cssPool.start);
+		if (cssPool.quit) break;
+		cssResolveChunks();
+		SemAdd(cssPool.done, 1);
+	}
+	SemAdd(cssPool.done, 1);
+}
+
+static void cssStopWorkers(void)
+{
+	int i;
+	if (cssPool.threads == 0) return;
+	cssPool.quit = 1;
+	SemAdd(cssPool.start, cssPool.threads);
+	for (i = 0; i < cssPool.threads; SemWait(cssPool.done), i ++);
+	SemClose(cssPool.start);
+	SemClose(cssPool.done);
+	MutexDestroy(cssPool.lock);
+	cssPool.threads = 0;
+	cssPool.quit = 0;
+}
+
+#define	cssPoolHash(node)      ((((size_t) (node)) >> 4) * 2654435761u)
+
+static void cssFreeResolved(void)
+{
+	CSSResolved res;
+	int         i;
+	for (i = cssPool.count, res = cssPool.nodes; i > 0; i --, res ++)
+		vector_free(res->styles);
+	free(cssPool.nodes);
+	free(cssPool.hash);
+	cssPool.nodes = NULL;
+	cssPool.hash  = NULL;
+	cssPool.count = 0;
+}
+
+static CSSResolved cssFindResolved(SIT_Widget node)
+{
+	int slot;
+	if (cssPool.hash == NULL) return NULL;
+	for (slot = cssPoolHash(node) & (cssPool.hashSize - 1); cssPool.hash[slot]; slot = (slot + 1) & (cssPool.hashSize - 1))
+	{
+		CSSResolved res = cssPool.nodes + cssPool.hash[slot] - 1;
+		if (res->node == node) return res->flags >= 0 ? res : NULL;
+	}
+	return NULL;
+}
+
+/* resolve styles of the entire tree starting at <root>: must be called within cssShareStyles(True/False) */
+void cssResolveTree(SIT_Widget root)
+{
+	SIT_Widget list;
+	int        count, i;
+
+	if (sit.cpuCount < 2 || cssPool.nodes || cssShareEnabled == 0) return;
+
+	/* atoms are lazily updated: make sure it won't be done from a worker thread */
+	cssSetMatchAtoms(root);
+
+	for (list = root, count = 0; ; )
+	{
+		if (list->atomTag != list->tagName) cssSetAtoms(list);
+		count ++;
+		if (! list->children.lh_Head)
+		{
+			if (list == root) break;
+			while (list->node.ln_Next == NULL)
+			{
+				list = list->parent;
+				if (list == root) goto break_all;
+			}
+			list = (SIT_Widget) list->node.ln_Next;
+		}
+		else list = (SIT_Widget) list->children.lh_Head;
+	}
+	break_all:
+	if (count < CSS_PARALLELMIN) return;
+
+	if (cssPool.threads == 0)
+	{
+		cssPool.start = SemInit(0);
+		cssPool.done  = SemInit(0);
+		cssPool.lock  = MutexCreate();
+		cssPool.threads = MIN(sit.cpuCount, CSS_MAXTHREADS) - 1;
+		for (i = 0; i < cssPool.threads; ThreadCreate(cssResolveWorker, NULL), i ++);
+	}
+
+	for (cssPool.hashSize = 64; cssPool.hashSize < count * 2; cssPool.hashSize <<= 1);
+	cssPool.nodes = calloc(count, sizeof *cssPool.nodes);
+	cssPool.hash  = calloc(cssPool.hashSize, sizeof *cssPool.hash);
+	cssPool.count = count;
+	cssPool.next  = 0;
+
+	for (list = root, i = 0; i < count; i ++)
+	{
+		int slot;
+		cssPool.nodes[i].node = list;
+		for (slot = cssPoolHash(list) & (cssPool.hashSize - 1); cssPool.hash[slot]; slot = (slot + 1) & (cssPool.hashSize - 1));
+		cssPool.hash[slot] = i + 1;
+
+		if (list->children.lh_Head) { list = (SIT_Widget) list->children.lh_Head; continue; }
+		while (list != root && list->node.ln_Next == NULL) list = list->parent;
+		if (list == root) break;
+		list = (SIT_Widget) list->node.ln_Next;
+	}
+
+	/* main thread will process its share too */
+	SemAdd(cssPool.start, cssPool.threads);
+	cssResolveChunks();
+	for (i = 0; i < cssPool.threads; SemWait(cssPool.done), i ++);
+}
+
+/*
+ * cssApply: apply CSS styles to given SIT_Widget. Rules are indexed by their rightmost
+ * compound selector (see cssIndexRule()): only those that can possibly match this node
+ * are tested. Descendant/child selectors whose ancestors are not in the bloom filter of
+ * the stack are rejected without backtracking.
  */
 int cssApply(SIT_Widget node)
 {
 	Style        oldStyles;
-	CSSRule      rule;
 	CSSStyle     style;
 	SIT_Widget   parent;
-	SIT_Widget * stack;
-	uint8_t      applied, level, state;
+	CSSResolved  res;
+	uint8_t      applied, state;
+	struct CSSShare_t key;
+	CSSShare     share;
+	Bool         canShare;
+	uint64_t     fingerprint;
 	int          i;
 
-	cssStyles.count = 0;
-
-	for (level = 0, parent = node; parent; level ++, parent = parent->parent);
-	stack = alloca(sizeof *stack * level);
-	for (i = level-1, parent = node; parent; stack[i] = parent, i --, parent = parent->parent);
-
 	cssStyles.count = 0;
 	applied = node->style.flags & CSSF_APPLIED;
 	state   = node->state;
@@ -1465,19 +1967,41 @@ int cssApply(SIT_Widget node)
 	if (node->enabled == 0)
 		state = 7;
 
-	for (rule = (CSSRule) sit.theme, i = 0; rule < (CSSRule) (sit.theme + sit.themeSize); rule = (CSSRule) (sit.theme + rule->next), i ++)
+	/* ancestors atoms are needed for bloom filter and selector matching */
+	cssSetMatchAtoms(node);
+
+	canShare = cssShareKey(node, &key);
+	if ((res = cssFindResolved(node)))
 	{
-		if (cssMatchSelector(stack, level, rule))
-			cssAddStyles(&cssStyles, (STRPTR *) (sit.theme + rule->styles), rule->nbstyles, rule->specif, 1);
-		if (rule->next == 0) break;
+		/* done by cssResolveTree() */
+		node->stateDeps = res->stateDeps;
+		fingerprint = res->fingerprint;
+		if (res->styles.count > 0)
+		{
+			vector_nth(&cssStyles, res->styles.count - 1);
+			memcpy(cssStyles.buffer, res->styles.buffer, res->styles.count * sizeof *style);
+		}
 	}
+	else if (canShare && (share = cssShareFind(&key)))
+	{
+		/* a sibling already matched these rules */
+		node->stateDeps = share->stateDeps;
+		fingerprint = share->fingerprint;
+		if (share->styles.count > 0)
+		{
+			vector_nth(&cssStyles, share->styles.count - 1);
+			memcpy(cssStyles.buffer, share->styles.buffer, share->styles.count * sizeof *style);
+		}
+	}
+	else
+	{
+		i = cssResolve(node, &cssStyles, &fingerprint, &node->stateDeps, False);
 
-	if (node->inlineStyles)
-		cssAddStyles(&cssStyles, node->inlineStyles, 1e6, 0xff<<16, 2);
-
-	qsort(cssStyles.buffer, cssStyles.count, sizeof *style, cssSortStyle);
+		if (canShare && (i & CSSRF_NOSHARE) == 0)
+			cssShareAdd(&key, &cssStyles, node->stateDeps, fingerprint);
+	}
 
-	i = cssCRC32(&cssStyles);
+	i = (uint32_t) (fingerprint ^ (fingerprint >> 32));
 	if (i == node->layout.curCRC32 && applied)
 	{
 		node->layout.crc32[state] = i;
@@ -1491,6 +2015,11 @@ int cssApply(SIT_Widget node)
 		return cssGetInherited(node);
 	}
 
+	/* old extent: outline or box-shadow might shrink */
+	for (parent = node; parent->type == SIT_HTMLTAG; parent = parent->parent);
+	if (parent->visible && applied)
+		SIT_RefreshWidget(parent);
+
 	memcpy(&oldStyles, &node->style, sizeof oldStyles);
 	cssSetDefault(node);
 	node->layout.curCRC32 = node->layout.crc32[state] = i;
@@ -1502,31 +2031,28 @@ int cssApply(SIT_Widget node)
 	{
 		fprintf(stderr, "\n*** styles for state %d [%d] = %x\n", node->state, state, i);
 		for (i = 0, style = vector_first(cssStyles); i < cssStyles.count; i ++, style ++)
-			fprintf(stderr, "    %s: %s\n", style->attr, style->value);
+			fprintf(stderr, "    %s: %s\n", style->decl->attr, style->decl->value);
 	}
 	#endif
 
 	/* DEBUG: ((CSSStyle)cssStyles.buffer) */
 	for (i = 0, style = vector_first(cssStyles); i < cssStyles.count; i ++, style ++)
-	{
-		STRPTR sep = strchr(style->value, '!');
-		TEXT   old = 0;
-		if (sep) sep -= (sep[-1] == ' '), old = *sep, *sep = 0;
-		cssApplyAttribute(node, style->attr, style->value);
-		if (sep) *sep = old;
-	}
+		cssApplyAttribute(node, cssattrs + style->decl->index, style->decl->value, style->decl);
 
 	/* check for layout change: has to be done after everything has been processed */
 	if (applied)
 	{
 		for (i = 0, style = vector_first(cssStyles); i < cssStyles.count; i ++, style ++)
-			node->style.reflow |= cssCheckChange(node, &oldStyles, cssAttrSearch(style->attr));
+			node->style.reflow |= cssCheckChange(node, &oldStyles, cssattrs + style->decl->index);
 	}
 	cssPostProcess(node);
 
 	node->style.flags |= CSSF_APPLIED;
-	for (parent = node; parent->type == SIT_HTMLTAG; parent = parent->parent);
-	sit.dirty |= parent->visible;
+	if (parent->visible)
+		SIT_RefreshWidget(parent);
+	if (! applied || (node->style.reflow & ReflowLayout))
+		node->measureGen = 0, parent->layout.lines.count = 0;
+	parent->drawGen = 0;
 
 	return node->style.reflow;
 }
@@ -1557,6 +2083,13 @@ Bool cssCRCChanged(SIT_Widget node)
 		pos = 7;
 	else
 		pos = state2crc[state];
+
+	/* no rule that can match this node depends on the state that changed */
+	if ((node->style.flags & CSSF_APPLIED) && ((node->oldState ^ state) & node->stateDeps) == 0)
+	{
+		if (node->enabled) node->layout.crc32[pos] = node->layout.curCRC32;
+		return 0;
+	}
 	return node->layout.crc32[old] != node->layout.crc32[pos];
 }
 
@@ -143,6 +143,8 @@ static WordWrap layoutGetWordWrap(SIT_Widget node, int nthLast)
 {
 	int      old = node->layout.wordwrap.count;
 	WordWrap word = vector_nth(&node->layout.wordwrap, nthLast + old);
+	node->layout.lines.count = 0;
+	node->drawGen = 0;
 	return word;
 }
 
@@ -377,6 +379,8 @@ static void layoutAddSymbol(SIT_Widget node, STRPTR uri, Bool fullH)
 	for (offset = node; offset->type == SIT_HTMLTAG; offset = offset->parent);
 
 	WordWrap w = vector_nth(&offset->layout.wordwrap, offset->layout.wordwrap.count);
+	offset->layout.lines.count = 0;
+	offset->drawGen = 0;
 
 	nvgFontFaceId(sit.nvgCtx, node->style.font.handle);
 	nvgFontSize(sit.nvgCtx,   node->style.font.size);
@@ -475,6 +479,8 @@ static STRPTR layoutParseTag(SIT_Widget * parent, DATA8 start)
 	{
 		while (offset->type == SIT_HTMLTAG) offset = offset->parent;
 		int count = offset->layout.wordwrap.count;
+		offset->layout.lines.count = 0;
+		offset->drawGen = 0;
 		if (count > 0) count --;
 		WordWrap w = vector_nth(&offset->layout.wordwrap, count);
 		if (w->nl == 1)
@@ -527,6 +533,7 @@ static STRPTR layoutParseTag(SIT_Widget * parent, DATA8 start)
 	node->parent  = offset;
 	if (! node->name)
 		node->name = node->tagName;
+	cssSetAtoms(node);
 
 	/* append node in the tree */
 	ListAddTail(&offset->children, &node->node);
@@ -628,6 +635,8 @@ void layoutFree(SIT_Widget start)
 	SIT_Widget node, next;
 
 	start->layout.wordwrap.count = 0;
+	start->layout.lines.count = 0;
+	start->drawGen = 0;
 	/* tree of nodes */
 	for (node = next = HEAD(start->children); node; )
 	{
@@ -1003,9 +1012,19 @@ void layoutSetSize(SIT_Widget node)
 /* class or state has changed */
 int layoutUpdateStyles(SIT_Widget node)
 {
+	if (sit.updateCount > 0)
+	{
+		/* will be done once in SIT_EndUpdate() */
+		SIT_DelayStyles(node);
+		return 0;
+	}
+
+	uint32_t crc = node->layout.curCRC32;
 	int changes = cssCRCChanged(node) ? cssApply(node) : 0;
 
-	if (node->flags & SITF_PrivateChildren)
+	/* children only need to be restyled if they can inherit something or match a different rule */
+	if ((node->flags & SITF_PrivateChildren) && (changes || crc != node->layout.curCRC32 ||
+	    (node->flags & SITF_RecalcStyles) || ((node->oldState ^ node->state) & cssAncestorStates())))
 	{
 		SIT_Widget c;
 		int ret = 0;
@@ -1034,7 +1053,7 @@ int layoutUpdateStyles(SIT_Widget node)
 				SIT_Widget max;
 				if ((max = (SIT_Widget) node->max.ln_Next) || (max = (SIT_Widget) node->max.ln_Prev))
 					current.width = max->box.right - max->box.left;
-				node->optimalWidth(node, &current, (APTR) FitUsingCurrentBox);
+				SIT_Measure(node, &current, FitUsingCurrentBox);
 				if (! ALMOST0(current.width - node->currentBox.width) || ! ALMOST0(current.height - node->currentBox.height))
 				{
 					memcpy(&node->currentBox, &current, sizeof current);
@@ -1135,11 +1154,38 @@ void layoutMeasureWords(SIT_Widget node, SizeF * ret)
 
 	/* compute width and prepare height */
 	REAL maxw, maxh, maxWidth = ret->width;
-	REAL height, asc, desc, off, tmp;
+	REAL height, asc, desc, off, tmp, fit, next;
 	if (node->maxBox.width > maxWidth)
 		maxWidth = node->maxBox.width;
 	if (maxWidth <= 0) maxWidth = sit.root->fixed.width;
-	for (w = word = vector_first(node->layout.wordwrap), maxw = maxh = width = height = asc = desc = 0; i > 0; w ++)
+	if (node->layout.lines.itemsize == 0)
+		vector_init(node->layout.lines, sizeof (struct WrapLine_t));
+
+	/* lines from previous call that will break at the same words can be kept as is */
+	WrapLine line = vector_first(node->layout.lines);
+	int      keep = node->layout.lines.count;
+	word = vector_first(node->layout.wordwrap);
+	for (maxw = maxh = 0; keep > 0 && line->fit <= maxWidth && (line->next == 0 || line->next > maxWidth) &&
+	     line->lineHeight == lineHeight; keep --, line ++)
+	{
+		if (maxw < line->width)
+			maxw = line->width;
+		maxh += line->height;
+		w = word + line->start;
+		if (w->marginL < 0)
+			w->marginL = 0; /* cancel text-align */
+	}
+	if (node->layout.lines.count > 0 && keep == 0)
+	{
+		ret->height = maxh;
+		ret->width  = MIN(maxw, maxWidth);
+		node->layout.textarea = *ret;
+		return;
+	}
+	keep = node->layout.lines.count -= keep;
+	if (keep > 0) i -= line->start, word += line->start;
+
+	for (w = word, width = height = asc = desc = fit = next = 0; i > 0; w ++)
 	{
 		REAL h = w->h;
 		w->nl &= ~2; /* remove previous soft line break */
@@ -1173,10 +1219,17 @@ void layoutMeasureWords(SIT_Widget node, SizeF * ret)
 		tmp = w->width + w->space + w->marginL + w->marginR;
 		if (width + tmp > maxWidth && w > word && layoutCanBreak(node, w->node))
 		{
+			next = width + tmp;
 			w --;
 			w->nl |= 2;
 		}
-		else width += tmp, i --;
+		else
+		{
+			/* smallest width that won't break this line before <w> */
+			if (width + tmp > fit && w > word && layoutCanBreak(node, w->node))
+				fit = width + tmp;
+			width += tmp, i --;
+		}
 		if (w->nl || i == 0)
 		{
 			desc += asc;
@@ -1187,6 +1240,13 @@ void layoutMeasureWords(SIT_Widget node, SizeF * ret)
 				asc += lineHeight - height;
 				height = lineHeight;
 			}
+			line = vector_nth(&node->layout.lines, keep ++);
+			line->start = word - (WordWrap) vector_first(node->layout.wordwrap);
+			line->fit   = fit;
+			line->next  = next;
+			line->width = width;
+			line->height = height;
+			line->lineHeight = lineHeight;
 			/* compute height and assign baseline to each word */
 			while (word <= w)
 			{
@@ -1208,7 +1268,7 @@ void layoutMeasureWords(SIT_Widget node, SizeF * ret)
 			if (maxw < width)
 				maxw = width;
 			maxh += height;
-			width = height = asc = desc = 0;
+			width = height = asc = desc = fit = next = 0;
 		}
 	}
 	ret->height = maxh;
@@ -1255,6 +1315,9 @@ void layoutRecalcWords(SIT_Widget w)
 	REAL     fh, bl, space;
 	int      i = w->layout.wordwrap.count;
 
+	w->layout.lines.count = 0;
+	w->drawGen = 0;
+
 	for (word = vector_first(w->layout.wordwrap), old = NULL, space = 0; i > 0; word ++, i --)
 	{
 		if (old != word->node)
@@ -857,7 +857,8 @@ DATA8 cssAllocThemeBytes(int size, APTR data)
 {
 	if (sit.themeSize + size > sit.themeMax)
 	{
-		sit.themeMax = (sit.themeSize + size + 255) & ~255;
+		/* grow geometrically: stylesheets with data: URI can be several MB */
+		sit.themeMax = (sit.themeSize + size + sit.themeMax / 2 + 255) & ~255;
 		DATA8 mem = realloc(sit.theme, sit.themeMax);
 		if (! mem) return NULL;
 		sit.theme = mem;
@@ -870,19 +871,20 @@ DATA8 cssAllocThemeBytes(int size, APTR data)
 
 /*
  * parse CSS block attributes
- * transform them into table of key/value pairs (NULL-terminated)
+ * transform them into table of precompiled key/value pairs
  */
 static STRPTR cssParseStyles(STRPTR start, int * count)
 {
-	STRPTR * attr = NULL;
-	STRPTR   fmt = skipspace(start);
-	int      nb = 0;
+	CSSDecl attr = NULL;
+	STRPTR  fmt = skipspace(start);
+	int     nb = 0, first = sit.themeSize;
 
 	while (*fmt && *fmt != '}')
 	{
 		if (attr == NULL)
-			attr = (STRPTR *) cssAllocThemeBytes(2 * sizeof (STRPTR), NULL);
-		attr[0] = fmt;
+			attr = (CSSDecl) cssAllocThemeBytes(sizeof *attr, NULL);
+		memset(attr, 0, sizeof *attr);
+		attr->attr = fmt;
 		fmt = cssIdent(fmt);
 
 		if (*fmt == ':')
@@ -914,8 +916,8 @@ static STRPTR cssParseStyles(STRPTR start, int * count)
 			}
 			if (start < fmt)
 			{
-				StrToLower(attr[0], -1);
-				attr[1] = start;
+				StrToLower(attr->attr, -1);
+				attr->value = start;
 				nb ++;
 				if (*fmt == '}') { *fmt = 0; cssNormalizeSpace(start); *fmt = '}'; break; }
 				if (*fmt == ';') { *fmt++ = 0; }
@@ -935,6 +937,10 @@ static STRPTR cssParseStyles(STRPTR start, int * count)
 	}
 	if (*fmt == '}') *fmt ++ = 0;
 	*count = nb;
+
+	/* values are all NUL-terminated now */
+	for (attr = (CSSDecl) (sit.theme + first); nb > 0; cssCompileDecl(attr), attr ++, nb --);
+
 	return fmt;
 }
 
@@ -953,23 +959,217 @@ void cssParseInlineStyles(SIT_Widget node, STRPTR styles)
 		cssParseStyles(styles, &count);
 		if (count > 0)
 		{
-			count *= 2;
-			node->inlineStyles = malloc((count + 1) * sizeof (STRPTR) + length + 1);
-			STRPTR dup = (STRPTR) (node->inlineStyles + count + 1);
-			STRPTR * attr;
+			node->inlineStyles = malloc((count + 1) * sizeof *node->inlineStyles + length + 1);
+			STRPTR  dup = (STRPTR) (node->inlineStyles + count + 1);
+			CSSDecl attr;
 			memcpy(dup, styles, length + 1);
-			memcpy(node->inlineStyles, sit.theme + commit, count * sizeof (STRPTR));
-			node->inlineStyles[count] = NULL;
+			memcpy(node->inlineStyles, sit.theme + commit, count * sizeof *attr);
+			node->inlineStyles[count].attr = NULL;
 			sit.themeSize = commit;
 			commit = dup - styles;
 			/* inlineStyles still points to a stack allocated mem block at this point */
-			for (attr = node->inlineStyles; count > 0; attr[0] += commit, count --, attr ++);
+			for (attr = node->inlineStyles; count > 0; count --, attr ++)
+			{
+				attr->attr  += commit;
+				attr->value += commit;
+				if (attr->flags & CSSD_POINTER)
+					attr->val.str += commit;
+			}
+		}
+	}
+}
+
+/*
+ * atoms: tag names, ids and classes are interned into integers when selectors are compiled and
+ * widgets created. Selector matching will then only have to compare integers instead of strings.
+ */
+struct CSSAtom_t
+{
+	STRPTR   name;              /* lowercase */
+	uint16_t next;              /* next atom in hash chain */
+};
+
+#define	CSS_ATOMHASH    256
+
+static vector_t cssAtoms;
+static uint16_t cssAtomHash[CSS_ATOMHASH];
+
+/* get unique id for name (case insensitive), 0 if name is NULL */
+int cssAtom(STRPTR name, int len)
+{
+	struct CSSAtom_t * atom;
+	uint32_t hash;
+	int      i, id;
+
+	if (name == NULL) return 0;
+	if (len < 0) len = strlen(name);
+	for (i = 0, hash = 5381; i < len; hash = hash * 33 + tolower(name[i]), i ++);
+
+	uint16_t * head = cssAtomHash + (hash & (CSS_ATOMHASH - 1));
+	for (id = *head; id > 0; id = atom->next)
+	{
+		atom = vector_nth(&cssAtoms, id - 1);
+		if (strncasecmp(atom->name, name, len) == 0 && atom->name[len] == 0)
+			return id;
+	}
+	cssAtoms.itemsize = sizeof *atom;
+	atom = vector_nth(&cssAtoms, cssAtoms.count);
+	atom->name = malloc(len + 1);
+	atom->next = *head;
+	memcpy(atom->name, name, len);
+	atom->name[len] = 0;
+	StrToLower(atom->name, len);
+	return *head = cssAtoms.count;
+}
+
+void cssFreeAtoms(void)
+{
+	struct CSSAtom_t * atom;
+	int i;
+	for (i = cssAtoms.count, atom = vector_first(cssAtoms); i > 0; free(atom->name), i --, atom ++);
+	vector_free(cssAtoms);
+	memset(&cssAtoms, 0, sizeof cssAtoms);
+	memset(cssAtomHash, 0, sizeof cssAtomHash);
+}
+
+/* intern tag name, id and classes of widget */
+void cssSetAtoms(SIT_Widget node)
+{
+	STRPTR p, start;
+	DATA16 atoms;
+	int    count;
+
+	node->atomTag = node->tagName;
+	node->tagAtom = cssAtom(node->tagName, -1);
+	node->idAtom  = cssAtom(node->name, -1);
+	if (node->classAtoms)
+		free(node->classAtoms), node->classAtoms = NULL;
+
+	for (p = node->classes, count = 0; p && *(p = skipspace(p)); count ++)
+		while (*p && ! cssIsSpace(*p)) p ++;
+
+	if (count == 0) return;
+	node->classAtoms = atoms = malloc((count + 1) * sizeof *atoms);
+
+	/* keep them sorted: matching will be able to stop early */
+	for (p = node->classes, count = 0; *(start = p = skipspace(p)); count ++)
+	{
+		int atom, i;
+		while (*p && ! cssIsSpace(*p)) p ++;
+		atom = cssAtom(start, p - start);
+		for (i = count; i > 0 && atoms[i-1] > atom; atoms[i] = atoms[i-1], i --);
+		atoms[i] = atom;
+	}
+	atoms[count] = 0;
+}
+
+/*
+ * rule index: rules are grouped according to the rightmost compound of their selector, that
+ * way cssApply() only has to test rules that have a chance to match a given node.
+ */
+static CSSIndex cssIndex;
+
+/* get bucket of rules indexed by <atom> (type is CSSR_ID, CSSR_CLASS or CSSR_TAG, anything else: universal) */
+vector cssIndexBucket(int type, int atom)
+{
+	atom &= CSS_INDEXSZ - 1;
+	switch (type) {
+	case CSSR_ID:    return cssIndex.id      + atom;
+	case CSSR_CLASS: return cssIndex.classes + atom;
+	case CSSR_TAG:   return cssIndex.tag     + atom;
+	default:         return &cssIndex.universal;
+	}
+}
+
+/* state bits each pseudo-class depends on (same order than CSS_PSEUDOCLASSES) */
+static uint8_t cssPseudoStates[] = {
+	0, STATE_ACTIVATED, STATE_HOVER, STATE_FOCUS, STATE_KBDFOCUS, STATE_CHECKED, STATE_DISABLED
+};
+
+/* get most selective item of rightmost compound selector (NULL if only universal) */
+static CSSSel cssRuleSubject(CSSRule rule)
+{
+	CSSSel sel, best;
+	int    i;
+
+	/* rightmost compound: up to first selector that has a combinator */
+	for (i = rule->nbsel - 1, best = NULL; i >= 0; i --)
+	{
+		sel = (CSSSel) (rule + 1) + i;
+		switch (sel->type) {
+		case CSSR_ID:
+			best = sel;
+			break;
+		case CSSR_CLASS:
+			if (best == NULL || best->type != CSSR_ID) best = sel;
+			break;
+		case CSSR_TAG:
+			if (best == NULL && sel->atom > 0) best = sel;
+		default: break;
+		}
+		if (sel->trans != CSST_CURRENT) break;
+	}
+	return best;
+}
+
+static void cssIndexRule(CSSRule rule, int offset)
+{
+	CSSSel sel, best;
+	vector bucket;
+	int    i, subject;
+
+	/* which state changes can modify the set of nodes matched by this rule */
+	for (i = rule->nbsel - 1, subject = 1; i >= 0; i --)
+	{
+		sel = (CSSSel) (rule + 1) + i;
+		if (sel->type == CSSR_PSEUDO && sel->atom > 0)
+		{
+			if (subject) rule->states |= cssPseudoStates[sel->atom - 1];
+			else cssIndex.ancestorStates |= cssPseudoStates[sel->atom - 1];
 		}
+		if (sel->trans != CSST_CURRENT) subject = 0;
 	}
+
+	best   = cssRuleSubject(rule);
+	bucket = best ? cssIndexBucket(best->type, best->atom) : &cssIndex.universal;
+	bucket->itemsize = sizeof offset;
+	* (int *) vector_nth(bucket, bucket->count) = offset;
+}
+
+int cssAncestorStates(void)
+{
+	return cssIndex.ancestorStates;
+}
+
+void cssFreeIndex(void)
+{
+	vector v;
+	for (v = cssIndex.id; v <= &cssIndex.universal; v ++)
+		vector_free(*v);
+	memset(&cssIndex, 0, sizeof cssIndex);
+}
+
+static int cssSortOffset(const void * item1, const void * item2)
+{
+	return * (int *) item1 - * (int *) item2;
+}
+
+/* get offset of all rules from index, in declaration order */
+static void cssGetRules(CSSIndex * index, vector rules)
+{
+	vector v;
+	vector_init(*rules, sizeof (int));
+	for (v = index->id; v <= &index->universal; v ++)
+	{
+		if (v->count == 0) continue;
+		vector_nth(rules, rules->count + v->count - 1);
+		memcpy(rules->buffer + (rules->count - v->count) * sizeof (int), v->buffer, v->count * sizeof (int));
+	}
+	qsort(rules->buffer, rules->count, sizeof (int), cssSortOffset);
 }
 
 /* transform selector string into something more easily parsable */
-static CSSRule cssCompileSelector(STRPTR start, int prevRule)
+static CSSRule cssCompileSelector(STRPTR start)
 {
 	STRPTR p, sel, prev;
 	CSSSel compil = alloca(sizeof *compil * (CharInSet(start, ">:+[].# \t") + 5));
@@ -977,7 +1177,7 @@ static CSSRule cssCompileSelector(STRPTR start, int prevRule)
 	int    length = 0;
 	int    rule   = CSSR_NONE;
 	int    trans  = CSST_CURRENT;
-	int    next   = 0;
+	int    next   = 0, i;
 
 	for (p = prev = start; *p; )
 	{
@@ -1064,13 +1264,45 @@ static CSSRule cssCompileSelector(STRPTR start, int prevRule)
 		}
 	}
 
+	/* all items are NUL-terminated at this point: intern them */
+	for (i = 0; i < length; i ++)
+	{
+		CSSSel item = compil + i;
+		switch (item->type) {
+		case CSSR_TAG:    item->atom = item->item[0] == '*' ? 0 : cssAtom(item->item, -1); break;
+		case CSSR_PSEUDO: item->atom = FindInList(CSS_PSEUDOCLASSES, item->item, 0) + 1; break;
+		case CSSR_CLASS:
+		case CSSR_ID:     item->atom = cssAtom(item->item, -1); break;
+		default:          item->atom = 0;
+		}
+	}
+
 	struct CSSRule_t cssr = {.nbsel = length, .specif = specif};
 
-	if (prevRule >= 0)
+	/* collect items that must match an ancestor of the node (ie: left of a ' ' or '>') */
+	for (i = length - 1, trans = 0, next = 0; i >= 0 && next < CSS_MAXANCESTORS; i --)
+	{
+		CSSSel item = compil + i;
+		if (trans && item->atom > 0 && (item->type == CSSR_TAG || item->type == CSSR_CLASS || item->type == CSSR_ID))
+			cssr.ancestors[next ++] = item->atom;
+		switch (item->trans) {
+		case CSST_ANY:
+		case CSST_CHILD:   trans = 1; break;
+		case CSST_SIBLING: trans = 0; /* sibling of an ancestor */
+		default: break;
+		}
+	}
+
+	/* rules that prevent siblings from sharing their matched styles */
+	for (i = 0; i < length; i ++)
 	{
-		CSSRule previous = (CSSRule) (sit.theme + prevRule);
-		previous->next = sit.themeSize;
+		CSSSel item = compil + i;
+		if (item->trans == CSST_SIBLING || item->type >= CSSR_ATTR || (item->type == CSSR_PSEUDO && item->atom == 1 /* link */))
+			cssr.flags |= CSSRF_NOSHARE;
+		if (item->type == CSSR_PSEUDO && item->atom == 1)
+			cssr.flags |= CSSRF_LINK;
 	}
+
 	rule = sit.themeSize;
 	cssAllocThemeBytes(sizeof cssr, &cssr);
 	cssAllocThemeBytes(length * sizeof *compil, compil);
@@ -1099,7 +1331,7 @@ static void cssParseString(STRPTR rules, STRPTR rel)
 			if (*p == ',' || *p == '{')
 			{
 				end = (*p == '{'); *p++ = 0;
-				rule = cssCompileSelector(start, sit.lastRule);
+				rule = cssCompileSelector(start);
 				start = skipspace(p);
 				if (rule == NULL)
 				{
@@ -1114,7 +1346,6 @@ static void cssParseString(STRPTR rules, STRPTR rel)
 					/* we have to compile the selector but discard it anyway because of previous errors */
 					sit.themeSize = commit;
 				}
-				else sit.lastRule = (DATA8) rule - sit.theme;
 			}
 			else if (*p == '\"' || *p == '\'')
 			{
@@ -1129,13 +1360,15 @@ static void cssParseString(STRPTR rules, STRPTR rel)
 			p = cssParseStyles(p, &count);
 			if (count > 0)
 			{
-				int first = commit;
-				do {
+				int first;
+				/* all selectors of this block are stored right before its declarations */
+				for (first = commit; first < offset; first += sizeof *rule + rule->nbsel * sizeof (struct CSSSel_t))
+				{
 					rule = (CSSRule) (sit.theme + first);
 					rule->styles = offset;
 					rule->nbstyles = count;
-					first = rule->next;
-				} while (first > 0);
+					cssIndexRule(rule, first);
+				}
 			}
 			else sit.themeSize = commit; /* empty declaration: nuke all selectors */
 			eof = p;
@@ -1144,6 +1377,204 @@ static void cssParseString(STRPTR rules, STRPTR rel)
 	}
 }
 
+/*
+ * compiled stylesheet cache: the theme buffer, the text it points to (with all the NUL
+ * inserted by the parser) and the atom names are dumped in the user's application data
+ * folder (theme folder can be read-only). Pointers are saved as offsets in the text, and
+ * relocated when loaded back.
+ */
+#define	CSS_CACHEVER     2
+#define	CSS_CACHEDIR     "SITGL"
+#define	CSS_CACHEEXT     ".cache"
+
+struct CSSCache_t
+{
+	TEXT     magic[4];      /* "SITC" */
+	uint32_t attrsCRC;      /* cssattrs table index are stored: must be same table */
+	uint16_t version;
+	uint8_t  sizes[2];      /* sizeof rule and decl records */
+	uint32_t srcTime;       /* modification time and size of CSS file */
+	uint32_t srcSize;
+	uint32_t textSize;      /* followed by text, theme, atom names (NUL separated), rule offsets */
+	uint32_t themeSize;
+	uint32_t atomSize;
+	uint32_t atomCount;
+	uint32_t ruleCount;
+};
+
+uint32_t crc32(uint32_t crc, DATA8 buf, int max);
+
+/* cache file for stylesheet <path>: named after the CRC of its path */
+static Bool cssCachePath(STRPTR path, STRPTR out, int max)
+{
+	TEXT name[16];
+	if (! GetDefaultPath(FOLDER_APPDATA, out, max)) return False;
+	sprintf(name, "%08x" CSS_CACHEEXT, crc32(0, path, -1));
+	return AddPart(out, CSS_CACHEDIR, max) && AddPart(out, name, max);
+}
+
+/* "*" is the only selector item that does not point within stylesheet */
+#define	CSS_CACHESTAR    ((size_t) -1)
+
+static STRPTR cssCacheToOffset(STRPTR p, STRPTR buf, int size)
+{
+	if (defCSS <= p && p < EOT(defCSS)) return (STRPTR) (size_t) (p - defCSS);
+	if (buf <= p && p <= buf + size)    return (STRPTR) (size_t) (p - buf + sizeof defCSS);
+	return (STRPTR) CSS_CACHESTAR;
+}
+
+static STRPTR cssCacheFromOffset(STRPTR p, STRPTR text)
+{
+	return (size_t) p == CSS_CACHESTAR ? "*" : text + (size_t) p;
+}
+
+/* convert pointers of all rules and declarations from/to offsets */
+static void cssCacheRelocate(DATA8 theme, int * rules, int count, STRPTR text, STRPTR buf, int size)
+{
+	uint32_t styles;
+	int      i, j;
+
+	for (i = 0, styles = ~0; i < count; i ++)
+	{
+		CSSRule rule = (CSSRule) (theme + rules[i]);
+		CSSSel  sel  = (CSSSel) (rule + 1);
+		CSSDecl decl;
+
+		for (j = rule->nbsel; j > 0; j --, sel ++)
+			sel->item = text ? cssCacheFromOffset(sel->item, text) : cssCacheToOffset(sel->item, buf, size);
+
+		/* selectors sharing the same declaration block are contiguous */
+		if (rule->styles == styles) continue;
+		styles = rule->styles;
+		for (j = rule->nbstyles, decl = (CSSDecl) (theme + styles); j > 0; j --, decl ++)
+		{
+			if (text)
+			{
+				decl->attr  = cssCacheFromOffset(decl->attr,  text);
+				decl->value = cssCacheFromOffset(decl->value, text);
+				if (decl->flags & CSSD_POINTER)
+					decl->val.str = cssCacheFromOffset(decl->val.str, text);
+			}
+			else
+			{
+				decl->attr  = cssCacheToOffset(decl->attr,  buf, size);
+				decl->value = cssCacheToOffset(decl->value, buf, size);
+				if (decl->flags & CSSD_POINTER)
+					decl->val.str = cssCacheToOffset(decl->val.str, buf, size);
+			}
+		}
+	}
+}
+
+static Bool cssLoadCache(STRPTR path, int size, ULONG mtime)
+{
+	struct CSSCache_t header;
+	uint16_t * remap;
+	STRPTR     name;
+	FILE *     in;
+	DATA8      mem;
+	int *      rules;
+	int        total, i;
+	TEXT       cache[256];
+
+	if (! cssCachePath(path, cache, sizeof cache)) return False;
+	in = fopen(cache, "rb");
+
+	if (in == NULL) return False;
+	if (fread(&header, sizeof header, 1, in) != 1 || memcmp(header.magic, "SITC", 4) ||
+	    header.attrsCRC != cssAttrsCRC() || header.version != CSS_CACHEVER ||
+	    header.sizes[0] != sizeof (struct CSSRule_t) || header.sizes[1] != sizeof (struct CSSDecl_t) ||
+	    header.srcTime != mtime || header.srcSize != size || sit.themeSize > 0)
+	{
+		fclose(in);
+		return False;
+	}
+
+	/* everything in one read: text block will be our sit.cssFile */
+	total = header.textSize + header.themeSize + header.atomSize + header.ruleCount * sizeof *rules;
+	mem   = malloc(total);
+	remap = malloc((header.atomCount + 1) * sizeof *remap);
+	if (mem == NULL || remap == NULL || fread(mem, total, 1, in) != 1)
+	{
+		free(mem); free(remap); fclose(in);
+		return False;
+	}
+	fclose(in);
+
+	if (! cssAllocThemeBytes(header.themeSize, mem + header.textSize))
+	{
+		free(mem); free(remap);
+		return False;
+	}
+
+	/* atoms id are not persistent across sessions */
+	for (i = 1, remap[0] = 0, name = (STRPTR) mem + header.textSize + header.themeSize; i <= header.atomCount; i ++, name = strchr(name, 0) + 1)
+		remap[i] = cssAtom(name, -1);
+
+	rules = (int *) (mem + header.textSize + header.themeSize + header.atomSize);
+	cssCacheRelocate(sit.theme, rules, header.ruleCount, (STRPTR) mem, NULL, 0);
+
+	for (i = 0; i < header.ruleCount; i ++)
+	{
+		CSSRule rule = (CSSRule) (sit.theme + rules[i]);
+		CSSSel  sel  = (CSSSel) (rule + 1);
+		int     j;
+
+		for (j = rule->nbsel; j > 0; j --, sel ++)
+			if (sel->type == CSSR_TAG || sel->type == CSSR_CLASS || sel->type == CSSR_ID) sel->atom = remap[sel->atom];
+		for (j = 0; j < CSS_MAXANCESTORS; j ++)
+			rule->ancestors[j] = remap[rule->ancestors[j]];
+
+		cssIndexRule(rule, rules[i]);
+	}
+	free(remap);
+
+	if (sit.cssFile) free(sit.cssFile);
+	sit.cssFile = (STRPTR) mem;
+	return True;
+}
+
+static void cssSaveCache(STRPTR path, STRPTR buf, int size, ULONG mtime)
+{
+	struct CSSCache_t header = {.magic = "SITC", .version = CSS_CACHEVER, .srcTime = mtime, .srcSize = size};
+	struct CSSAtom_t * atom;
+	vector_t rules;
+	DATA8    theme;
+	FILE *   out;
+	int      i;
+	TEXT     cache[256];
+
+	if (! cssCachePath(path, cache, sizeof cache) || CreatePath(cache, True)) return;
+	out = fopen(cache, "wb");
+	if (out == NULL) return;
+
+	cssGetRules(&cssIndex, &rules);
+
+	theme = malloc(sit.themeSize);
+	memcpy(theme, sit.theme, sit.themeSize);
+	cssCacheRelocate(theme, vector_first(rules), rules.count, NULL, buf, size);
+
+	header.attrsCRC  = cssAttrsCRC();
+	header.sizes[0]  = sizeof (struct CSSRule_t);
+	header.sizes[1]  = sizeof (struct CSSDecl_t);
+	header.textSize  = sizeof defCSS + size + 1;
+	header.themeSize = sit.themeSize;
+	header.atomCount = cssAtoms.count;
+	header.ruleCount = rules.count;
+	for (i = cssAtoms.count, atom = vector_first(cssAtoms); i > 0; header.atomSize += strlen(atom->name) + 1, i --, atom ++);
+
+	fwrite(&header, sizeof header, 1, out);
+	fwrite(defCSS, sizeof defCSS, 1, out);
+	fwrite(buf, size + 1, 1, out);
+	fwrite(theme, sit.themeSize, 1, out);
+	for (i = cssAtoms.count, atom = vector_first(cssAtoms); i > 0; fwrite(atom->name, strlen(atom->name) + 1, 1, out), i --, atom ++);
+	fwrite(rules.buffer, sizeof (int), rules.count, out);
+	fclose(out);
+
+	free(theme);
+	vector_free(rules);
+}
+
 /* initiate parsing of external CSS file */
 Bool cssParse(STRPTR css, int isPath)
 {
@@ -1156,8 +1587,20 @@ Bool cssParse(STRPTR css, int isPath)
 
 		if (in)
 		{
-			int sz;
+			ULONG mtime = TimeStamp(css, 2);
+			int   sz;
 			fseek(in, 0, SEEK_END); sz  = ftell(in);
+
+			if (cssLoadCache(css, sz, mtime))
+			{
+				/* sit.cssFile has been set to cached block */
+				fclose(in);
+				CopyString(sit.relPath, css, sizeof sit.relPath);
+				ParentDir(sit.relPath);
+				sit.relPathSz = strlen(sit.relPath);
+				return True;
+			}
+
 			fseek(in, 0, SEEK_SET); buf = malloc(sz + 1);
 			fread(buf, sz, 1, in);  buf[sz] = 0;
 			fclose(in);
@@ -1165,6 +1608,7 @@ Bool cssParse(STRPTR css, int isPath)
 			/* pre-def styles need to be parsed before */
 			cssParseString(defCSS, NULL);
 			cssParseString(buf, css);
+			cssSaveCache(css, buf, sz, mtime);
 
 			/* make all resources relative to where stylesheet is */
 			CopyString(sit.relPath, css, sizeof sit.relPath);
@@ -1184,3 +1628,221 @@ Bool cssParse(STRPTR css, int isPath)
 	return True;
 }
 
+
+/*
+ * stylesheet hot reload: keep previous theme around, to find which rules have been added,
+ * removed or modified. Only widgets that can match one of those will have to be restyled.
+ */
+struct CSSTheme_t
+{
+	DATA8    theme;
+	uint32_t themeSize;
+	STRPTR   cssFile;
+	CSSIndex index;
+};
+
+typedef struct CSSRuleSig_t *   CSSRuleSig;
+
+struct CSSRuleSig_t
+{
+	uint32_t sig;           /* checksum of selectors and declarations */
+	uint32_t key;           /* (type << 16) | atom of rightmost compound, 0 if universal */
+	int      order;
+	int      matched;
+};
+
+static vector_t cssChanged;    /* uint32_t: keys of modified rules, sorted */
+static vector_t cssOldText;    /* STRPTR: text of previous themes, still referenced by widgets */
+
+/* detach current theme: next cssParse() will start from scratch */
+CSSTheme cssSaveTheme(void)
+{
+	CSSTheme old = malloc(sizeof *old);
+
+	old->theme     = sit.theme;
+	old->themeSize = sit.themeSize;
+	old->cssFile   = sit.cssFile;
+	old->index     = cssIndex;
+	memset(&cssIndex, 0, sizeof cssIndex);
+	sit.theme = NULL;
+	sit.cssFile = NULL;
+	sit.themeSize = sit.themeMax = 0;
+
+	return old;
+}
+
+void cssFreeTheme(CSSTheme old)
+{
+	vector v;
+	for (v = old->index.id; v <= &old->index.universal; v ++)
+		vector_free(*v);
+
+	/* styles of widgets not restyled can point to this */
+	if (old->cssFile)
+	{
+		cssOldText.itemsize = sizeof old->cssFile;
+		* (STRPTR *) vector_nth(&cssOldText, cssOldText.count) = old->cssFile;
+	}
+	free(old->theme);
+	free(old);
+}
+
+/* all widgets have been restyled */
+void cssFreeOldThemes(void)
+{
+	STRPTR * text;
+	int      i;
+	for (i = cssOldText.count, text = vector_first(cssOldText); i > 0; free(*text), i --, text ++);
+	vector_free(cssOldText);
+	vector_free(cssChanged);
+	memset(&cssOldText, 0, sizeof cssOldText);
+	memset(&cssChanged, 0, sizeof cssChanged);
+}
+
+static CSSRuleSig cssGetSignatures(DATA8 theme, CSSIndex * index, int * count)
+{
+	CSSRuleSig sigs, sig;
+	vector_t   rules;
+	int *      offset;
+	int        i, j;
+
+	cssGetRules(index, &rules);
+	sigs = malloc((rules.count + 1) * sizeof *sigs);
+
+	for (i = 0, offset = vector_first(rules), sig = sigs; i < rules.count; i ++, offset ++, sig ++)
+	{
+		CSSRule  rule = (CSSRule) (theme + *offset);
+		CSSSel   sel  = (CSSSel) (rule + 1);
+		CSSDecl  decl = (CSSDecl) (theme + rule->styles);
+		uint32_t crc  = 0;
+
+		for (j = rule->nbsel; j > 0; j --, sel ++)
+		{
+			uint8_t type[] = {sel->type, sel->trans};
+			crc = crc32(crc32(crc, type, 2), sel->item, -1);
+			/* attribute selectors: value is stored after item */
+			if (sel->type >= CSSR_ATTR)
+				crc = crc32(crc, strchr(sel->item, 0) + 1, -1);
+		}
+		for (j = rule->nbstyles; j > 0; j --, decl ++)
+			crc = crc32(crc32(crc32(crc, decl->attr, -1), decl->value, -1), &decl->flags, 1);
+
+		sel = cssRuleSubject(rule);
+		sig->sig = crc;
+		sig->key = sel ? (sel->type << 16) | sel->atom : 0;
+		sig->order = i;
+		sig->matched = 0;
+	}
+	*count = rules.count;
+	vector_free(rules);
+	return sigs;
+}
+
+static int cssSortSig(const void * item1, const void * item2)
+{
+	CSSRuleSig sig1 = (CSSRuleSig) item1;
+	CSSRuleSig sig2 = (CSSRuleSig) item2;
+	if (sig1->sig < sig2->sig) return -1;
+	if (sig1->sig > sig2->sig) return  1;
+	return sig1->order - sig2->order;
+}
+
+static int cssSortOrder(const void * item1, const void * item2)
+{
+	return ((CSSRuleSig) item1)->order - ((CSSRuleSig) item2)->order;
+}
+
+static int cssSortKey(const void * item1, const void * item2)
+{
+	uint32_t key1 = * (uint32_t *) item1;
+	uint32_t key2 = * (uint32_t *) item2;
+	return key1 < key2 ? -1 : key1 > key2 ? 1 : 0;
+}
+
+static void cssAddChanged(CSSRuleSig sig, int count)
+{
+	for (; count > 0; count --, sig ++)
+	{
+		if (sig->matched) continue;
+		* (uint32_t *) vector_nth(&cssChanged, cssChanged.count) = sig->key;
+	}
+}
+
+/*
+ * compare previous theme with current one: returns 0 if nothing changed, 1 if some rules have
+ * been added/removed/modified (see cssRulesChanged()) or 2 if everything needs to be restyled.
+ */
+int cssDiffTheme(CSSTheme old)
+{
+	CSSRuleSig oldSigs, newSigs, s1, s2, end1, end2;
+	int        oldCount, newCount, ret;
+
+	oldSigs = cssGetSignatures(old->theme, &old->index, &oldCount);
+	newSigs = cssGetSignatures(sit.theme, &cssIndex, &newCount);
+
+	/* pair identical rules (multiset intersection) */
+	qsort(oldSigs, oldCount, sizeof *oldSigs, cssSortSig);
+	qsort(newSigs, newCount, sizeof *newSigs, cssSortSig);
+	for (s1 = oldSigs, s2 = newSigs, end1 = s1 + oldCount, end2 = s2 + newCount; s1 < end1 && s2 < end2; )
+	{
+		if (s1->sig < s2->sig) s1 ++; else
+		if (s1->sig > s2->sig) s2 ++;
+		else s1->matched = s2->matched = 1, s1 ++, s2 ++;
+	}
+
+	/* rules that were kept must be in the same order, otherwise cascade might be different */
+	qsort(oldSigs, oldCount, sizeof *oldSigs, cssSortOrder);
+	qsort(newSigs, newCount, sizeof *newSigs, cssSortOrder);
+	for (s1 = oldSigs, s2 = newSigs, ret = 0; ; s1 ++, s2 ++)
+	{
+		while (s1 < end1 && ! s1->matched) s1 ++, ret = 1;
+		while (s2 < end2 && ! s2->matched) s2 ++, ret = 1;
+		if (s1 == end1 || s2 == end2) break;
+		if (s1->sig != s2->sig) { ret = 2; break; }
+	}
+
+	vector_free(cssChanged);
+	vector_init(cssChanged, sizeof (uint32_t));
+	if (ret == 1)
+	{
+		cssAddChanged(oldSigs, oldCount);
+		cssAddChanged(newSigs, newCount);
+		qsort(cssChanged.buffer, cssChanged.count, sizeof (uint32_t), cssSortKey);
+		/* universal rule modified: can't really be more specific */
+		if (* (uint32_t *) cssChanged.buffer == 0)
+			ret = 2;
+	}
+	free(oldSigs);
+	free(newSigs);
+	return ret;
+}
+
+static Bool cssKeyChanged(uint32_t key)
+{
+	uint32_t * keys = vector_first(cssChanged);
+	int        min  = 0, max = cssChanged.count - 1;
+
+	while (min <= max)
+	{
+		int mid = (min + max) >> 1;
+		if (keys[mid] == key) return True;
+		if (keys[mid] < key) min = mid + 1;
+		else max = mid - 1;
+	}
+	return False;
+}
+
+/* can <node> match one of the rules modified since previous theme (see cssDiffTheme()) */
+Bool cssRulesChanged(SIT_Widget node)
+{
+	DATA16 atom;
+	if (node->atomTag != node->tagName)
+		cssSetAtoms(node);
+
+	if (cssKeyChanged((CSSR_TAG << 16) | node->tagAtom)) return True;
+	if (node->idAtom && cssKeyChanged((CSSR_ID << 16) | node->idAtom)) return True;
+	for (atom = node->classAtoms; atom && *atom; atom ++)
+		if (cssKeyChanged((CSSR_CLASS << 16) | *atom)) return True;
+
+	return False;
+}
@@ -12,7 +12,10 @@
 typedef struct CSSStyle_t *     CSSStyle;
 typedef struct CSSRule_t *      CSSRule;
 typedef struct CSSSel_t *       CSSSel;
+typedef struct CSSDecl_t *      CSSDecl;
 typedef struct CSSImage_t *     CSSImage;
+typedef struct CSSIndex_t       CSSIndex;
+typedef struct CSSTheme_t *     CSSTheme;
 
 
 void   cssInit(void);
@@ -27,16 +30,31 @@ Bool   cssParseGradient(STRPTR fmt, STRPTR * pend, Gradient * mem);
 Bool   cssParseURI(STRPTR fmt, STRPTR * pend, STRPTR * mem);
 Bool   cssParse(STRPTR css, int isPath);
 void   cssParseInlineStyles(SIT_Widget, STRPTR styles);
+void   cssCompileDecl(CSSDecl);
 ULONG  cssColorSearch(STRPTR name);
 REAL   cssApplyFontSize(SIT_Widget, ULONG size);
 
 int    cssApply(SIT_Widget);
+void   cssShareStyles(Bool enable);
+void   cssResolveTree(SIT_Widget root);
 void   cssClear(SIT_Widget);
 Bool   cssCRCChanged(SIT_Widget);
 void   cssSetDefault(SIT_Widget);
 int    cssTokenizer(STRPTR start, STRPTR * end);
 DATA8  cssIdent(DATA8);
 int    cssIsSpace(int chr);
+vector cssIndexBucket(int type, int atom);
+void   cssFreeIndex(void);
+int    cssAncestorStates(void);
+CSSTheme cssSaveTheme(void);
+int    cssDiffTheme(CSSTheme old);
+void   cssFreeTheme(CSSTheme old);
+void   cssFreeOldThemes(void);
+Bool   cssRulesChanged(SIT_Widget);
+int    cssAtom(STRPTR name, int len);
+void   cssSetAtoms(SIT_Widget);
+void   cssFreeAtoms(void);
+uint32_t cssAttrsCRC(void);
 
 CSSImage cssAddImage(STRPTR uri, Bool mask, Bool fromCSS);
 CSSImage cssAddGradient(Gradient * grad, int w, int h, REAL fh);
@@ -80,13 +98,24 @@ typedef enum                /* possible values for 'CSSSel.trans' */
 	CSST_SIBLING,
 }	CSSRuleTrans;
 
-struct CSSRule_t
+#define	CSS_MAXANCESTORS      4   /* atoms per rule that can be checked against ancestor bloom filter */
+#define	CSS_BLOOMSZ           256 /* bits in ancestor bloom filter */
+
+struct CSSRule_t            /* followed by <nbsel> CSSSel, rules sharing a declaration block are contiguous */
 {
-	uint16_t next;
+	uint32_t styles;        /* offset of CSSDecl array in sit.theme */
+	int      specif;
 	uint8_t  nbsel;
 	uint8_t  nbstyles;
-	int      specif;
-	uint16_t styles;
+	uint8_t  flags;         /* CSSRF_* */
+	uint8_t  states;        /* STATE_* bits that pseudo-classes of rightmost compound depend on */
+	uint16_t ancestors[CSS_MAXANCESTORS]; /* tag/class/id atoms required in ancestors, 0 if less */
+};
+
+enum /* possible values for 'CSSRule.flags' */
+{
+	CSSRF_NOSHARE = 1,      /* match depends on more than tag/id/classes/state: see cssShareStyles() */
+	CSSRF_LINK    = 2       /* uses :link pseudo-class (will modify matched node) */
 };
 
 struct CSSSel_t             /* selector item */
@@ -94,14 +123,50 @@ struct CSSSel_t             /* selector item */
 	STRPTR       item;
 	CSSRuleType  type:8;    /* no need to alloc 4 bytes for these */
 	CSSRuleTrans trans:8;
+	uint16_t     atom;      /* interned item (tag, class, id; 0 for '*') or pseudo-class index + 1 */
+};
+
+/* pseudo-classes supported: order matters, see cssMatchSelector() */
+#define	CSS_PSEUDOCLASSES     "link,active,hover,focus,kbdfocus,checked,disabled"
+
+struct CSSDecl_t            /* property/value pair, precompiled when stylesheet is loaded */
+{
+	STRPTR   attr;
+	STRPTR   value;
+	int16_t  index;         /* in CSS attribute table, -1 if unsupported or invalid */
+	uint8_t  size;          /* > 0 if <val> has been parsed from <value>: only needs to be copied */
+	uint8_t  flags;         /* CSSD_* */
+	union {
+		ULONG    u32;
+		uint8_t  u8;
+		REAL     real;
+		CSSColor col;
+		STRPTR   str;
+	}	val;
+};
+
+enum /* possible values for 'CSSDecl.flags' */
+{
+	CSSD_IMPORTANT = 1,     /* !important */
+	CSSD_POINTER   = 2      /* val.str points within <value> */
 };
 
 struct CSSStyle_t
 {
-	STRPTR attr;
-	STRPTR value;
-	int    specif;
-	int    order;
+	CSSDecl decl;
+	int     specif;
+	int     order;
+};
+
+#define	CSS_INDEXSZ     64  /* hash buckets per selector type */
+
+struct CSSIndex_t           /* rules grouped by rightmost compound selector (offset in sit.theme, increasing order) */
+{
+	vector_t id[CSS_INDEXSZ];
+	vector_t classes[CSS_INDEXSZ];
+	vector_t tag[CSS_INDEXSZ];
+	vector_t universal;
+	uint8_t  ancestorStates; /* STATE_* bits used by pseudo-classes not in rightmost compound */
 };
 
 struct CSSImage_t
@@ -21,6 +21,7 @@ typedef struct BoxF_t          BoxF;
 typedef struct Box_t           Box;
 typedef struct Gradient_t      Gradient;
 typedef struct WordWrap_t *    WordWrap;
+typedef struct WrapLine_t *    WrapLine;
 typedef struct LineHdr_t *     LineHdr;
 typedef struct RectF_t         RectF;
 typedef struct PointF_t        PointF;
@@ -202,6 +203,16 @@ struct WordWrap_t
 	char   va;        /* vertical-align method */
 };
 
+struct WrapLine_t  /* line break of layoutMeasureWords(), to reuse lines that will not change when width does */
+{
+	int    start;     /* index of first word in layout.wordwrap */
+	REAL   fit;       /* minimal width to keep all the words of this line */
+	REAL   next;      /* line will have to break before this width (0 if forced break or last line) */
+	REAL   width;
+	REAL   height;
+	REAL   lineHeight;
+};
+
 /* special value for WordWrap.y */
 #define	VATOP        1000000
 #define	VABOTTOM     1000001
@@ -253,6 +264,7 @@ struct Layout_t               /* this structure will contain usable values for t
 	REAL       scrollHeight;
 	REAL       scrollLeft;    /* left position to start rendering */
 	vector_t   wordwrap;
+	vector_t   lines;         /* WrapLine: cleared when words change */
 	short      startword;     /* inline element: used to render box and bg */
 	short      nbword;        /* inline: words it spans in the containing block */
 };
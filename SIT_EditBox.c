@@ -447,7 +447,7 @@ static int SIT_TextEditBlinkCaret(SIT_Widget w, APTR cd, APTR ud)
 {
 	SIT_EditBox edit = (SIT_EditBox) w;
 	edit->caretVisible ^= 1;
-	sit.dirty = True;
+	SIT_RefreshWidget(w);
 	return sit.caretBlinkMS;
 }
 
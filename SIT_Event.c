@@ -828,6 +828,8 @@ DLLIMP void SIT_ProcessResize(int width, int height)
 	{
 		sit.scrWidth  = width;
 		sit.scrHeight = height;
+		sit.measureGen ++;
+		sit.drawGen ++;
 
 		w->box.right  = w->fixed.width  = w->maxBox.width  = width;
 		w->box.bottom = w->fixed.height = w->maxBox.height = height;
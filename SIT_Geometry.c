@@ -6,7 +6,9 @@
  * written by T.Pierron, june 2006
  */
 
+#include <stdlib.h>
 #include <string.h>
+#include <malloc.h>
 #include <stddef.h>
 #include <math.h>
 #include "SIT_P.h"
@@ -109,6 +111,8 @@ int SIT_LayoutWidget(SIT_Widget root, SIT_Widget w, int side /* 0: horiz, 1:vert
 	REAL         percent[2];
 	REAL         chldsz = (adjust == FitUsingOptimalBox ? &w->optimalBox.width : &w->currentBox.width)[side];
 
+	if (side == 0) sit.layoutCount ++;
+
 	if (adjust == FitUsingInitialBox && (w->flags & (SITF_FixedWidth<<side)))
 		chldsz = (&w->fixed.width)[side];
 
@@ -327,14 +331,105 @@ int SIT_LayoutWidget(SIT_Widget root, SIT_Widget w, int side /* 0: horiz, 1:vert
 	return ret;
 }
 
-/* children's box have been setup, calc their pos in the container */
-static int SIT_LayoutChildren(SIT_Widget root, ResizePolicy mode)
+/* get widget that must be positioned before <w> on side [0-3] (NULL if none), <report>: log missing relative */
+static SIT_Widget SIT_GetDependency(SIT_Widget w, int side, Bool report)
+{
+	static STRPTR sides[] = {"left", "top", "right", "bottom"};
+
+	SIT_Attach * a = SIT_ReassignAttachment(w, side);
+	SIT_Widget   s = (SIT_Widget) a->sa_Arg;
+
+	if (! relative[a->sa_Type]) return NULL;
+	if (s == NULL)
+	{
+		if (report) SIT_Log(SIT_CRITICAL, "Missing relative %s control for '%s'", sides[side], w->name);
+		return NULL;
+	}
+	return s->visible ? s : NULL;
+}
+
+static int SIT_CmpWidget(const void * item1, const void * item2)
+{
+	SIT_Widget w1 = * (SIT_Widget *) item1;
+	SIT_Widget w2 = * (SIT_Widget *) item2;
+	return w1 < w2 ? -1 : w1 > w2 ? 1 : 0;
+}
+
+static int SIT_IndexOf(SIT_Widget * nodes, int count, SIT_Widget w)
+{
+	SIT_Widget * pos = bsearch(&w, nodes, count, sizeof *nodes, SIT_CmpWidget);
+	return pos ? pos - nodes : -1;
+}
+
+/*
+ * sort children of a container so that widgets are placed after the ones they are attached to, on
+ * one axis (side: 0 or 1). <nodes> must be sorted by address. Returns False if there is a cycle.
+ */
+static Bool SIT_SortChildren(SIT_Widget root, SIT_Widget * nodes, int count, int side, SIT_Widget * order)
+{
+	uint8_t * state = alloca(count);
+	int *     stack = alloca(count * 3 * sizeof *stack);
+	int       i, j, sp, nb;
+
+	memset(state, 0, count);
+	for (i = nb = 0; i < count; i ++)
+	{
+		/* iterative depth-first search: state 1 = on current path, 2 = done */
+		for (stack[0] = i, sp = 1; sp > 0; )
+		{
+			int t = stack[sp-1];
+			if (state[t] == 0)
+			{
+				state[t] = 1;
+				for (j = side; j < 4; j += 2)
+				{
+					int k = SIT_IndexOf(nodes, count, SIT_GetDependency(nodes[t], j, True));
+					if (k < 0) continue;
+					if (state[k] == 1)
+					{
+						SIT_Log(SIT_CRITICAL, "Circular attachment between '%s' and '%s' in '%s'", nodes[t]->name, nodes[k]->name, root->name);
+						return False;
+					}
+					if (state[k] == 0) stack[sp++] = k;
+				}
+			}
+			else
+			{
+				sp --;
+				if (state[t] == 1) state[t] = 2, order[nb++] = nodes[t];
+			}
+		}
+	}
+	return True;
+}
+
+/* <nodes> must have room for 3 * <total> items: visible children, then their order on each axis */
+static Bool SIT_GetLayoutOrder(SIT_Widget root, SIT_Widget * nodes, int total)
 {
 	SIT_Widget list;
-	int        count, total, i, init, loop;
-	SizeF      min = {0, 0};
+	int        count;
+
+	for (list = HEAD(root->children), count = 0; list; NEXT(list))
+		if (list->visible && (list->flags & SITF_TopLevel) == 0) nodes[count++] = list;
+	qsort(nodes, total, sizeof *nodes, SIT_CmpWidget);
+	return SIT_SortChildren(root, nodes, total, 0, nodes + total) &&
+	       SIT_SortChildren(root, nodes, total, 1, nodes + total * 2);
+}
 
-	/* apply maxWidth constraints */
+/* children's box have been setup, calc their pos in the container */
+static int SIT_LayoutChildren(SIT_Widget root, ResizePolicy mode)
+{
+	SIT_Widget   list;
+	SIT_Widget * nodes;
+	SIT_Widget * order[2];
+	int          count, total, i, j;
+	SizeF        min = {0, 0};
+
+	/*
+	 * apply maxWidth constraints: widths are equalized before placing anything, they are not edges
+	 * of the dependency graph (would report false cycles when a widget is attached to one of its
+	 * chain predecessors from the other side).
+	 */
 	root->layout.flags &= ~LAYF_HasAttach;
 	for (list = HEAD(root->children), total = count = 0; list; NEXT(list))
 	{
@@ -372,13 +467,26 @@ static int SIT_LayoutChildren(SIT_Widget root, ResizePolicy mode)
 		(int) root->box.left, (int) root->box.top, (int) root->box.right, (int) root->box.bottom, (int) root->minBox.width, (int) root->minBox.height);
 	#endif
 
+	/*
+	 * dependency order of attachments: each axis will then be done in a single pass. Not cached on the
+	 * container: it depends on visibility of siblings and attachments, that can be changed from a lot
+	 * of places. Sorting is O(n log n) on pointers with no allocation, that is a lot cheaper than
+	 * SIT_LayoutWidget() that will be called for each of these nodes anyway.
+	 */
+	nodes    = alloca(total * 3 * sizeof *nodes);
+	order[0] = nodes + total;
+	order[1] = nodes + total * 2;
+	if (! SIT_GetLayoutOrder(root, nodes, total))
+		return 0;
+
 	/* perform 2 steps: one for horizontal constraints, a second for vertical */
 	root->layout.flags &= ~LAYF_HasAttach;
 	for (i = 0; i < 2; i ++)
 	{
+		/* restart placement (order stays the same) if container box changed or a geometry callback asked for it */
 		redo_from_start:
 		root->flags &= ~SITF_StylesChanged;
-		for (init = 0, list = HEAD(root->children); list; NEXT(list))
+		for (list = HEAD(root->children); list; NEXT(list))
 		{
 			int flags = (SITF_FixedX | SITF_FixedWidth) << i;
 
@@ -393,56 +501,33 @@ static int SIT_LayoutChildren(SIT_Widget root, ResizePolicy mode)
 			}
 			list->flags &= ~ (SITF_GeometrySet | SITF_GeometryChanged | SITF_NoResetSize);
 			if ((list->flags & flags) == flags)
-				list->flags |= SITF_GeometrySet, init ++;
+				list->flags |= SITF_GeometrySet;
 		}
 
-		for (loop = init; loop < total; loop += count)
+		for (j = 0; j < total; j ++)
 		{
-			for (count = 0, list = HEAD(root->children); list; NEXT(list))
-			{
-				static STRPTR side[] = {"left", "top", "right", "bottom"};
-
-				SIT_Attach * a = SIT_ReassignAttachment(list, i); /* left / top */
-				SIT_Widget   w = (SIT_Widget) a->sa_Arg;
-
-				/* already done */
-				if (! list->visible || (list->flags & (SITF_TopLevel|SITF_GeometrySet)))
-					continue;
-
-				if (relative[a->sa_Type])
-				{
-					if (w == NULL)
-						SIT_Log(SIT_CRITICAL, "Missing relative %s control for '%s'", side[i], list->name);
-					/* there is dependency with a widget, but priority has not yet been determined */
-					if ((w->flags & SITF_GeometrySet) == 0 && w->visible) continue;
-				}
-
-				a = SIT_ReassignAttachment(list, i + 2); /* Right / bottom */
-				w = (SIT_Widget) a->sa_Arg;
-
-				if (relative[a->sa_Type])
-				{
-					if (w == NULL)
-						SIT_Log(SIT_CRITICAL, "Missing relative %s control for '%s'", side[i+2], list->name);
-				    if ((w->flags & SITF_GeometrySet) == 0 && w->visible) continue;
-				}
-
-				list->flags |= SITF_GeometrySet;
-				switch (SIT_LayoutWidget(root, list, i, mode)) {
-				case -1: i = 0; goto redo_from_start;
-				case  0: if (root->flags & (SITF_Style1Changed << i)) goto redo_from_start; /* container box changed, need to recompute everything */
-				/* else: ok */
-				}
-
-				/* control that have synchronized width/height (geomtest2) */
-				if (min.width  < list->box.right)  min.width  = list->box.right;
-				if (min.height < list->box.bottom) min.height = list->box.bottom;
-
-				count ++;
+			SIT_Widget w;
+			list = order[i][j];
+
+			/* fixed geometry */
+			if (list->flags & SITF_GeometrySet)
+				continue;
+
+			/* attached to a widget outside of this container: must have been done already */
+			if (((w = SIT_GetDependency(list, i, False))   && w->parent != root && (w->flags & SITF_GeometrySet) == 0) ||
+			    ((w = SIT_GetDependency(list, i+2, False)) && w->parent != root && (w->flags & SITF_GeometrySet) == 0))
+				return 0;
+
+			list->flags |= SITF_GeometrySet;
+			switch (SIT_LayoutWidget(root, list, i, mode)) {
+			case -1: i = 0; goto redo_from_start;
+			case  0: if (root->flags & (SITF_Style1Changed << i)) goto redo_from_start; /* container box changed, need to recompute everything */
+			/* else: ok */
 			}
 
-			/* ooops, dependency loop */
-			if (count == 0 && total > 0) return 0;
+			/* control that have synchronized width/height (geomtest2) */
+			if (min.width  < list->box.right)  min.width  = list->box.right;
+			if (min.height < list->box.bottom) min.height = list->box.bottom;
 		}
 	}
 	#ifdef DEBUG_GEOM
@@ -468,6 +553,28 @@ static int SIT_LayoutChildren(SIT_Widget root, ResizePolicy mode)
 	return 1;
 }
 
+/*
+ * optimalWidth() with a one entry cache: same constraints will give the same result until content or
+ * styles change. Only one entry, because some callbacks also set fields of the widget.
+ */
+void SIT_Measure(SIT_Widget w, SizeF * pref, ResizePolicy mode)
+{
+	if (w->measureGen == sit.measureGen && w->measureMode == mode &&
+	    ALMOST0(w->measured[0].width - pref->width) && ALMOST0(w->measured[0].height - pref->height) &&
+	    ALMOST0(w->measured[2].width - w->currentBox.width) && ALMOST0(w->measured[2].height - w->currentBox.height))
+	{
+		*pref = w->measured[1];
+		return;
+	}
+	w->measured[0] = *pref;
+	w->measured[2] = w->currentBox;
+	w->optimalWidth(w, pref, (APTR) mode);
+	w->measured[1] = *pref;
+	w->measureMode = mode;
+	/* children layout and render rect adjustment have side effects that we can't cache */
+	w->measureGen = w->children.lh_Head || (w->layout.flags & (LAYF_AdjustRect | LAYF_AdjustHitRect)) ? 0 : sit.measureGen;
+}
+
 /* check if changing size of widget <w> will reflow other controls (side: [0-1]) */
 static Bool SIT_CanReflow(SIT_Widget w, float oldSz, int side)
 {
@@ -625,7 +732,7 @@ Bool SIT_LayoutWidgets(SIT_Widget root, ResizePolicy mode)
 		if (list->optimalBox.width < 0)
 		{
 			if (list->optimalWidth)
-				list->optimalWidth(list, &list->optimalBox, (APTR) FitUsingOptimalBox);
+				SIT_Measure(list, &list->optimalBox, FitUsingOptimalBox);
 			if (list->minBox.width > 0 && list->optimalBox.width < list->minBox.width)
 				list->optimalBox.width = list->minBox.width;
 			if (list->minBox.height > 0 && list->optimalBox.height < list->minBox.height)
@@ -704,6 +811,96 @@ Bool SIT_LayoutWidgets(SIT_Widget root, ResizePolicy mode)
 	return True;
 }
 
+/*
+ * size of <w> changed: only lay out siblings that depend on it through attachments. Returns False
+ * if the container is affected too (caller will have to do a full layout of the dialog).
+ */
+static Bool SIT_LayoutDependents(SIT_Widget root, SIT_Widget w)
+{
+	SIT_Widget * nodes;
+	SIT_Widget   list;
+	uint8_t *    dirty;
+	REAL         pbox[4];
+	SizeF        min = {0, 0};
+	int          total, i, j;
+
+	if ((root->flags & SITF_PrivateChildren) || w->max.ln_Prev || w->max.ln_Next)
+		return False;
+
+	for (list = HEAD(root->children), total = 0; list; NEXT(list))
+		if (list->visible && (list->flags & SITF_TopLevel) == 0) total ++;
+
+	nodes = alloca(total * 3 * sizeof *nodes);
+	dirty = alloca(total);
+	if (total == 0 || ! SIT_GetLayoutOrder(root, nodes, total) || (i = SIT_IndexOf(nodes, total, w)) < 0)
+		return False;
+
+	memset(dirty, 0, total);
+	memcpy(pbox, &root->box, sizeof pbox);
+	dirty[i] = 1;
+	root->flags &= ~SITF_StylesChanged;
+
+	for (i = 0; i < 2; i ++)
+	{
+		SIT_Widget * order = nodes + total * (i + 1);
+		int          fixed = (SITF_FixedX | SITF_FixedWidth) << i;
+
+		/* children are sorted: dependencies will have their dirty bit set before their dependents */
+		for (j = 0; j < total; j ++)
+		{
+			int k = SIT_IndexOf(nodes, total, list = order[j]);
+			int d = SIT_IndexOf(nodes, total, SIT_GetDependency(list, i, False));
+			int e = SIT_IndexOf(nodes, total, SIT_GetDependency(list, i+2, False));
+
+			if (! dirty[k] && ! (d >= 0 && dirty[d]) && ! (e >= 0 && dirty[e]))
+				continue;
+
+			dirty[k] = 1;
+			if ((list->flags & SITF_NoResetSize) == 0)
+			{
+				if (i == 0) list->box.right  = list->fixed.width  + (list->box.left = list->fixed.left);
+				else        list->box.bottom = list->fixed.height + (list->box.top  = list->fixed.top);
+			}
+			list->flags &= ~ (SITF_GeometryChanged | SITF_NoResetSize);
+			if ((list->flags & fixed) == fixed)
+				continue;
+
+			/* container has to be resized */
+			if (SIT_LayoutWidget(root, list, i, FitUsingCurrentBox) <= 0 || memcmp(pbox, &root->box, sizeof pbox))
+			{
+				memcpy(&root->box, pbox, sizeof pbox);
+				return False;
+			}
+		}
+	}
+	root->flags &= ~SITF_StylesChanged;
+
+	for (j = 0; j < total; j ++)
+	{
+		list = nodes[j];
+		if (min.width  < list->box.right)  min.width  = list->box.right;
+		if (min.height < list->box.bottom) min.height = list->box.bottom;
+		if (! dirty[j]) continue;
+
+		SizeF old = list->currentBox = SIT_GetContentBox(list);
+		if (list->children.lh_Head && !(list->flags & SITF_PrivateChildren) && BoxSizeDiffers(list, &list->childBox))
+		{
+			SIT_LayoutWidgets(list, KeepDialogSize);
+			list->childBox = list->currentBox = SIT_GetContentBox(list);
+			if (! ALMOST0(old.width - list->currentBox.width) || ! ALMOST0(old.height - list->currentBox.height))
+				return False;
+		}
+		else SIT_LayoutCSSSize(list);
+	}
+
+	/* extent of children changed: container might have to be reduced */
+	if ((root->flags & SITF_Container) &&
+	    ! (ALMOST0(min.width + root->padding[2] - root->optimalBox.width) && ALMOST0(min.height + root->padding[3] - root->optimalBox.height)))
+		return False;
+
+	return True;
+}
+
 void SIT_ReflowLayout(SIT_Widget list)
 {
 	while (list)
@@ -744,13 +941,13 @@ void SIT_ReflowLayout(SIT_Widget list)
 				/* width constrained */
 				SIT_LayoutWidget(parent, list, 0, FitUsingCurrentBox);
 				pref.width = list->box.right - list->box.left;
-				list->optimalWidth(list, &pref, 0);
+				SIT_Measure(list, &pref, KeepDialogSize);
 				list->optimalBox = list->currentBox = pref;
 				SIT_LayoutWidget(parent, list, 1, FitUsingOptimalBox);
 			}
 			else /* not constrained */
 			{
-				list->optimalWidth(list, &pref, 0);
+				SIT_Measure(list, &pref, KeepDialogSize);
 				list->optimalBox = list->currentBox = pref;
 				SIT_LayoutWidget(parent, list, 0, FitUsingOptimalBox);
 				SIT_LayoutWidget(parent, list, 1, FitUsingOptimalBox);
@@ -771,7 +968,7 @@ void SIT_ReflowLayout(SIT_Widget list)
 				if (list->attachment[0].sa_Type == SITV_AttachNone || list->attachment[2].sa_Type == SITV_AttachNone)
 				{
 					done = 1;
-					list->optimalWidth(list, &pref, 0);
+					SIT_Measure(list, &pref, KeepDialogSize);
 					list->optimalBox = pref;
 					if (! SIT_LayoutWidget(parent, list, 0, FitUsingOptimalBox))
 						goto reflow;
@@ -786,7 +983,7 @@ void SIT_ReflowLayout(SIT_Widget list)
 
 				if (list->attachment[1].sa_Type == SITV_AttachNone || list->attachment[3].sa_Type == SITV_AttachNone)
 				{
-					if (! done) list->optimalWidth(list, &pref, 0), list->optimalBox = pref;
+					if (! done) SIT_Measure(list, &pref, KeepDialogSize), list->optimalBox = pref;
 					if (! SIT_LayoutWidget(parent, list, 1, FitUsingOptimalBox))
 						goto reflow;
 				}
@@ -826,6 +1023,12 @@ void SIT_ReflowLayout(SIT_Widget list)
 				reflow:
 				list->currentBox = list->optimalBox;
 				i = 0;
+				if (parent == list->parent)
+				{
+					/* try to only reposition the widgets attached to this one */
+					memcpy(&parent->box, pbox, sizeof pbox);
+					if (SIT_LayoutDependents(parent, list)) break;
+				}
 				while ((parent->flags & SITF_TopLevel) == 0)
 				{
 					//memset(&parent->currentBox, 0, sizeof parent->currentBox);
@@ -851,7 +1054,7 @@ void SIT_ReflowLayout(SIT_Widget list)
 void SIT_MeasureWidget(SIT_Widget w)
 {
 	SizeF pref = {0};
-	w->optimalWidth(w, &pref, (APTR) FitUsingOptimalBox);
+	SIT_Measure(w, &pref, FitUsingOptimalBox);
 	w->box.left = w->box.top = 0;
 	w->box.right = pref.width;
 	w->box.bottom = pref.height;
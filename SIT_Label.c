@@ -166,6 +166,8 @@ static int SIT_SetLabelValues(SIT_Widget w, APTR cd, APTR ud)
 		{
 			free(w->layout.wordwrap.buffer);
 			vector_init(w->layout.wordwrap, sizeof (struct WordWrap_t));
+			w->layout.lines.count = 0;
+			w->drawGen = 0;
 		}
 		w->flags |= SITF_GeometryChanged;
 		break;
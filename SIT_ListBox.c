@@ -300,6 +300,7 @@ static int SIT_ListRender(SIT_Widget w, APTR cd, APTR ud)
 				node->box.bottom = node->box.top + cell->sizeCell.height;
 				node->title = NULL;
 				node->layout.wordwrap.count = 0;
+				node->layout.lines.count = 0;
 
 				SIT_LayoutCSSSize(node);
 				SIT_RenderNode(node);
@@ -1677,6 +1678,7 @@ void SIT_ListClearStyles(SIT_Widget w, int flags)
 	int  i;
 
 	list->lbFlags &= ~SITV_ListMeasured;
+	w->measureGen = 0;
 	layoutClearStyles(list->td, flags);
 	layoutClearStyles(list->tdSel, flags);
 	for (i = list->columnCount, cell = list->columns;   i > 0; SIT_ListClearCell(list, cell, flags), i --, cell ++);
@@ -81,14 +81,17 @@ APTR SIT_FindControl(SIT_Widget, STRPTR utf8, int len, Bool recursive);
 int  SIT_LayoutWidget(SIT_Widget, SIT_Widget w, int side /* 0: horiz, 1:vert */, ResizePolicy adjust);
 Bool SIT_LayoutWidgets(SIT_Widget root, ResizePolicy mode);
 void SIT_ReflowLayout(SIT_Widget list);
+void SIT_Measure(SIT_Widget, SizeF * pref, ResizePolicy mode);
 void SIT_ParseTags(SIT_Widget, va_list vargs, TagList classArgs);
 void SIT_AddTitle(SIT_Widget, STRPTR text, int pos);
 int  SIT_SetWidgetValue(SIT_Widget, APTR cd, APTR ud);
 void SIT_LayoutCSSSize(SIT_Widget);
 void SIT_RenderNode(SIT_Widget);
+void SIT_FreeLayer(SIT_Widget);
 Bool SIT_ReassignAttachments(SIT_Widget);
 void SIT_ActionDispatch(double time);
 void SIT_InitiateReflow(SIT_Widget);
+void SIT_DelayStyles(SIT_Widget);
 void SIT_FreeCSS(SIT_Widget);
 void SIT_DestroyWidget(SIT_Widget);
 void SIT_DestroyChildren(SIT_Widget);
@@ -122,6 +125,7 @@ Bool renderWords(SIT_Widget, RectF * box, int shadowLayer);
 void renderBorder(SIT_Widget, RectF * box, int flag);
 void renderTextShadow(SIT_Widget, RectF * box);
 void renderInitBox(SIT_Widget, RectF * out, Bool init, int flag);
+void renderFreeShapes(void);
 
 STRPTR SIT_GetHTMLAttr(SIT_Widget node, STRPTR key);
 
@@ -166,14 +170,14 @@ struct SITContext_t
 	uint8_t      captureEvt;           /* capture mouse move in progress */
 	uint8_t      dirty;                /* need redraw */
 	uint8_t      refreshMode;
+	uint8_t      cpuCount;             /* logical processors (see cssResolveTree()) */
 	uint8_t      errorCode;            /* error at init (INIT_ERR_*) */
 	double       nextAction;           /* time in ms to wait before grabbing first item in <actions> field */
 	double       curTime;
 	STRPTR       cssFile;              /* keep memory we alloc */
 	DATA8        theme;                /* CSSRule, CSSSel, STRPTR */
-	uint16_t     themeMax;             /* mem allocated in <theme> */
-	uint16_t     themeSize;            /* mem used */
-	int          lastRule;
+	uint32_t     themeMax;             /* mem allocated in <theme> */
+	uint32_t     themeSize;            /* mem used */
 	float        fontScale;            /* multiply all font-size by this value */
 	ListHead     images;               /* CSSImage: keep in a cache, free after a while */
 	ListHead     actions;              /* SIT_Action */
@@ -183,6 +187,17 @@ struct SITContext_t
 	REAL         compoArea[4*MAXCOMPO];
 	uint8_t      compoIds[MAXCOMPO+1];
 	int          compoCount;
+	REAL         damage[4];            /* SITV_RefreshDamaged: area to redraw (x1, y1, x2, y2), empty if x1 >= x2 */
+	int          redrawArea[4];        /* area redrawn by last frame (SIT_RedrawArea) */
+	uint8_t      partialDraw;          /* rendering only <redrawArea> */
+	int          layerCount;           /* widgets with SIT_Layer set */
+	SIT_Widget   layerPass;            /* layer whose content is being rendered */
+	int          layoutCount;          /* widgets laid out since last frame (SIT_LayoutCount) */
+	uint32_t     measureGen;           /* increase to invalidate all measures (stylesheet, screen size) */
+	uint32_t     drawGen;              /* increase to invalidate all draw caches (geometry changed) */
+	APTR         shapes;               /* ShapeCache: tessellation of rounded borders/backgrounds */
+	int          updateCount;          /* SIT_BeginUpdate() nesting level */
+	vector_t     pendingStyles;        /* SIT_Widget: restyle delayed until SIT_EndUpdate() */
 	uint64_t     QPCfreq;
 	uint64_t     QPCstart;
 	uint64_t     QPCpause;
@@ -214,13 +229,28 @@ struct SIT_Widget_t
 	SIT_Widget   nextCtrl;
 	STRPTR       title, tagName;       /* public */
 	STRPTR       name, classes;        /* public */
-	STRPTR *     inlineStyles;         /* public */
+	struct CSSDecl_t * inlineStyles;   /* public */
+	STRPTR       atomTag;              /* tagName when atoms were computed */
+	uint16_t     tagAtom, idAtom;      /* interned tagName and name (see cssSetAtoms()) */
+	DATA16       classAtoms;           /* interned classes: sorted, 0-terminated */
+	uint8_t      stateDeps;            /* STATE_* bits that can change the rules matched by this node */
 	STRPTR       buddyText;
 	ListHead     children;
 	ListHead     callbacks;
 	int          evtFlags;             /* which evt has been set (quick filter): 1<<SITE_* */
 	ListNode     max;                  /* public: SIT_MaxWidth chain */
 	SizeF        optimalBox;           /* min size of control, border-box */
+	SizeF        measured[3];          /* last optimalWidth() call: constraint, result, currentBox (see SIT_Measure()) */
+	uint32_t     measureGen;           /* <measured> is valid if == sit.measureGen */
+	uint8_t      measureMode;          /* ResizePolicy of <measured> */
+	APTR         drawCache;            /* NVGrecord: decoration and text rendered last time (see renderNode()) */
+	uint32_t     drawGen;              /* <drawCache> is valid if == sit.drawGen */
+	uint32_t     drawCRC;              /* styles of <drawCache> */
+	REAL         drawKey[5];           /* width, height, scrollLeft, scrollTop, opacity of <drawCache> */
+	APTR         layerFBO;             /* NVGLUframebuffer: content of subtree if <layer> is set */
+	REAL         bounds[4];            /* area covered by subtree, relative to box origin (see SIT_RenderNode()) */
+	uint32_t     boundsGen;            /* <bounds> is valid if == sit.drawGen */
+	uint32_t     layerGen;             /* <layerFBO> is valid if == sit.drawGen */
 	SizeF        currentBox;           /* border-box */
 	SizeF        minBox, maxBox;
 	SizeF        childBox;             /* border-box */
@@ -240,6 +270,7 @@ struct SIT_Widget_t
 	uint8_t      cbSlot;
 	uint8_t      ptrEvents;            /* public */
 	uint8_t      composited;           /* public */
+	uint8_t      layer;                /* public: subtree is rendered in an offscreen buffer (SIT_Layer) */
 	int          flags;                /* SITF_* bitfield */
 	int          tabOrder;             /* public: visibility flags for tab control */
 	void *       userData;             /* public: retrieved using SIT_UserData */
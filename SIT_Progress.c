@@ -90,7 +90,7 @@ static int SIT_ProgressPostProcess(SIT_Widget w, APTR cd, APTR ud)
 	SizeF dummy;
 	layoutMeasureWords(w, &dummy);
 	SIT_ProgressResize(w, cd, ud);
-	sit.dirty = 1;
+	SIT_RefreshWidget(w);
 	return 1;
 }
 
@@ -15,6 +15,7 @@
 #include "SIT_CSSParser.h"
 #include "nanovg.h"
 #include "glad.h"
+#include "nanovg_gl_utils.h"
 
 /* optimize if border is fully opaque */
 static Bool renderIsFullyOpaqueBorder(Border * borders, int side)
@@ -343,6 +344,98 @@ static void renderCacheBorderImg(SIT_Widget node, RectF * box)
 	bimg->cache = cache;
 }
 
+/*
+ * shape cache: rounded backgrounds and borders are expensive to tessellate (arcs); widgets with the
+ * same geometry and colors (typically buttons from a theme) will share the same vertices.
+ */
+#define SHAPE_CACHE_SIZE     64
+
+uint32_t crc32(uint32_t crc, DATA8 buf, int max);
+
+typedef struct ShapeKey_t       ShapeKey;
+typedef struct ShapeCache_t *   ShapeCache;
+
+struct ShapeKey_t               /* must be memset() before use: compared with memcmp() */
+{
+	REAL     width, height;
+	BoxF     major, minor, border;
+	ULONG    colors[4];
+	REAL     opacity;
+	uint8_t  styles[4];
+	uint8_t  type, sides;       /* SHAPE_* */
+};
+
+struct ShapeCache_t
+{
+	ShapeKey key;
+	uint32_t crc;
+	APTR     rec;               /* NVGrecord, NULL if slot is empty */
+};
+
+enum /* possible values for ShapeKey.type */
+{
+	SHAPE_BACKGROUND = 1,
+	SHAPE_BORDER
+};
+
+/* replay cached shape at (x, y): if not possible, <record> will be set to the slot being recorded (or NULL) */
+static Bool renderReplayShape(ShapeKey * key, REAL x, REAL y, ShapeCache * record)
+{
+	ShapeCache shape;
+	uint32_t   crc;
+
+	*record = NULL;
+	/* layer content is rendered with a translation: vertices would not be at the same place */
+	if (sit.layerPass) return False;
+
+	if (sit.shapes == NULL && (sit.shapes = calloc(sizeof *shape, SHAPE_CACHE_SIZE)) == NULL)
+		return False;
+
+	crc = crc32(0, (DATA8) key, sizeof *key);
+	shape = (ShapeCache) sit.shapes + crc % SHAPE_CACHE_SIZE;
+
+	if (shape->rec && shape->crc == crc && memcmp(&shape->key, key, sizeof *key) == 0 &&
+	    nvgReplay(sit.nvgCtx, shape->rec, x, y))
+		return True;
+
+	/* empty or collision: replace previous content */
+	shape->key = *key;
+	shape->crc = crc;
+	shape->rec = nvgBeginRecord(sit.nvgCtx, shape->rec, x, y);
+	if (shape->rec) *record = shape;
+	return False;
+}
+
+static void renderSaveShape(ShapeCache shape)
+{
+	if (shape) nvgEndRecord(sit.nvgCtx);
+}
+
+/* path for background: rounded if major != NULL */
+static void renderBgPath(RectF * rect, BoxF * major, BoxF * minor)
+{
+	if (major)
+	{
+		REAL box[4] = {rect->left, rect->top, rect->width, rect->height};
+		nvgPathWinding(sit.nvgCtx, NVG_CCW);
+		nvgBeginPath(sit.nvgCtx);
+		renderRoundRect(box, major, minor, 0xff);
+	}
+	else renderRect(rect);
+}
+
+void renderFreeShapes(void)
+{
+	ShapeCache shape = sit.shapes;
+	int        i;
+
+	if (shape == NULL) return;
+	for (i = 0; i < SHAPE_CACHE_SIZE; i ++, shape ++)
+		nvgDeleteRecord(shape->rec);
+	free(sit.shapes);
+	sit.shapes = NULL;
+}
+
 /* render background-image (not to be confused with img.src) */
 static void renderBackground(SIT_Widget node, RectF * alt, int sides)
 {
@@ -350,7 +443,9 @@ static void renderBackground(SIT_Widget node, RectF * alt, int sides)
 	NVGCTX     vg = sit.nvgCtx;
 	BoxF       border = node->layout.border;
 	RectF      rect;
+	BoxF       major, minor;
 	int        count;
+	Bool       hasPath, round;
 
 	if (node->parent == NULL)
 	{
@@ -396,21 +491,19 @@ static void renderBackground(SIT_Widget node, RectF * alt, int sides)
 	rect.width  += border.left + border.right;
 	rect.height += border.top  + border.bottom;
 
-	if ((node->layout.flags & LAYF_NoRoundBorder) == 0)
+	round = (node->layout.flags & LAYF_NoRoundBorder) == 0;
+	if (round)
 	{
-		REAL box[4] = {rect.left, rect.top, rect.width, rect.height};
-		BoxF major = node->layout.majorRadius;
-		BoxF minor = node->layout.minorRadius;
+		major = node->layout.majorRadius;
+		minor = node->layout.minorRadius;
 		/* inlines can cut the border on left and right side, page breaks on top or bottom side */
 		if ((sides & 9) != 9) major.top = minor.top = 0;
 		if ((sides & 3) != 3) major.right = minor.right = 0;
 		if ((sides & 6) != 6) major.bottom = minor.bottom = 0;
 		if ((sides & 12) != 12) major.left = minor.left = 0;
-		nvgPathWinding(vg, NVG_CCW);
-		nvgBeginPath(vg);
-		renderRoundRect(box, &major, &minor, 0xff);
 	}
-	else renderRect(&rect);
+	/* path only needed for images/gradients: solid color use shape cache or nvgFillRect() */
+	hasPath = False;
 
 	/* multiple background declarations - ordered bottom to top */
 	for (count = node->style.bgCount; count > 0; count --, bg ++)
@@ -446,7 +539,31 @@ static void renderBackground(SIT_Widget node, RectF * alt, int sides)
 		if (bg->color.val != 0 && rect.height > 0 && rect.width > 0)
 		{
 			nvgFillColorRGBA8(vg, bg->color.rgba);
-			nvgFill(vg);
+			if (hasPath)
+			{
+				nvgFill(vg);
+			}
+			else if (round)
+			{
+				ShapeCache shape;
+				ShapeKey   key;
+				memset(&key, 0, sizeof key);
+				key.type    = SHAPE_BACKGROUND;
+				key.width   = rect.width;
+				key.height  = rect.height;
+				key.major   = major;
+				key.minor   = minor;
+				key.opacity = node->style.opacity;
+				key.colors[0] = bg->color.val;
+				if (! renderReplayShape(&key, rect.left, rect.top, &shape))
+				{
+					renderBgPath(&rect, &major, &minor);
+					hasPath = True;
+					nvgFill(vg);
+					renderSaveShape(shape);
+				}
+			}
+			else nvgFillRect(vg, rect.left, rect.top, rect.width, rect.height);
 		}
 
 		sides = (int) rect.width | ((int) rect.height << 16);
@@ -454,6 +571,7 @@ static void renderBackground(SIT_Widget node, RectF * alt, int sides)
 		{
 			/* radial-gradient with 2 color stops: use nanovg to render them directly; save quite a bit of memory */
 			int   info[4];
+			if (! hasPath) renderBgPath(&rect, round ? &major : NULL, &minor), hasPath = True;
 			DATA8 col1  = bg->gradient.colors[0].rgba;
 			DATA8 col2  = bg->gradient.colors[1].rgba;
 			gradientGetCenter(&bg->gradient, info, rect.width, rect.height, node->style.font.size);
@@ -497,6 +615,8 @@ static void renderBackground(SIT_Widget node, RectF * alt, int sides)
 		{
 			REAL x = bg->dim.left + border.left, w = bg->dim.width;
 			REAL y = bg->dim.top  + border.top,  h = bg->dim.height;
+			/* must be set before transformations */
+			if (! hasPath) renderBgPath(&rect, round ? &major : NULL, &minor), hasPath = True;
 			if (w == 0) w = img->width;
 			if (h == 0) h = img->height;
 
@@ -516,17 +636,16 @@ static void renderBackground(SIT_Widget node, RectF * alt, int sides)
 			y  = roundf(y);
 			w  = roundf(w);
 			h  = roundf(h);
+			/* scissor and paint transform only apply to this layer (keep base transform of caller) */
+			nvgSave(vg);
 			switch (bg->repeat) {
 			case 3: /* no-repeat */
-				nvgSave(vg);
 				nvgIntersectScissor(vg, x, y, w, h);
 				break;
 			case 2: /* repeat-y only */
-				nvgSave(vg);
 				nvgIntersectScissor(vg, x, y, w, sit.scrHeight);
 				break;
 			case 1: /* repeat-x only */
-				nvgSave(vg);
 				nvgIntersectScissor(vg, x, y, sit.scrWidth, h);
 			}
 			if (img->stretch) /* gradient */
@@ -538,7 +657,6 @@ static void renderBackground(SIT_Widget node, RectF * alt, int sides)
 				nvgRotate(vg, img->angle);
 				/* they are square, but need to be stretched to fill content */
 				nvgFillPaint(vg, nvgImagePattern(vg, 0, 0, grad[2], grad[2], 0, img->handle, 1));
-				nvgResetTransform(vg);
 			}
 			else if (img->angle != 0)
 			{
@@ -562,11 +680,9 @@ static void renderBackground(SIT_Widget node, RectF * alt, int sides)
 					paint.innerColor = nvgRGBA(col[0], col[1], col[2], col[3]);
 				}
 				nvgFillPaint(vg, paint);
-				nvgResetTransform(vg);
 			}
 			nvgFill(vg);
-			if (bg->repeat)
-				nvgRestore(vg);
+			nvgRestore(vg);
 		}
 	}
 }
@@ -786,6 +902,57 @@ static void renderArc(REAL * pts)
 		pts[4] < pts[5] ? NVG_CW : NVG_CCW);
 }
 
+static Bool renderIsAligned(REAL val)
+{
+	return fabsf(val - roundf(val)) < 0.01f;
+}
+
+/* square corners, solid and same color on all visible sides, pixel aligned: draw border as up to 4 quads */
+static Bool renderBorderRects(SIT_Widget node, BoxF * borders, RectF * box)
+{
+	Border * border;
+	Border * ref;
+	REAL     x, y, w, h, inner;
+	int      i;
+
+	if ((node->layout.flags & LAYF_NoRoundBorder) == 0)
+		return False;
+
+	for (i = 0, ref = NULL, border = &node->style.borderTop; i < 4; i ++, border ++)
+	{
+		if ((&borders->top)[i] <= 0) continue;
+		/* invisible sides next to visible ones need diagonal joints */
+		if (border->style != BorderStyleSolid || border->color.val == 0 || (ref && ref->color.val != border->color.val) ||
+		    ! renderIsAligned((&borders->top)[i]))
+			return False;
+		ref = border;
+	}
+	if (ref == NULL) return True; /* nothing to draw */
+
+	x = box->left - borders->left;
+	y = box->top  - borders->top;
+	w = box->width  + borders->left + borders->right;
+	h = box->height + borders->top  + borders->bottom;
+	/* otherwise, joints between quads will be visible with anti-aliasing */
+	if (! renderIsAligned(x) || ! renderIsAligned(y) || ! renderIsAligned(w) || ! renderIsAligned(h))
+		return False;
+
+	nvgFillColorRGBA8(sit.nvgCtx, ref->color.rgba);
+
+	inner = h - borders->top - borders->bottom;
+	for (i = 0; i < 4; i ++)
+	{
+		if ((&borders->top)[i] <= 0) continue;
+		switch (i) {
+		case 0: nvgFillRect(sit.nvgCtx, x, y, w, borders->top); break;
+		case 1: nvgFillRect(sit.nvgCtx, x + w - borders->right, y + borders->top, borders->right, inner); break;
+		case 2: nvgFillRect(sit.nvgCtx, x, y + h - borders->bottom, w, borders->bottom); break;
+		case 3: nvgFillRect(sit.nvgCtx, x, y + borders->top, borders->left, inner);
+		}
+	}
+	return True;
+}
+
 /*
  * border rendering: used by inline and block elements
  * note: dotted and dashed are not supported, use border-image instead
@@ -798,10 +965,11 @@ void renderBorder(SIT_Widget node, RectF * box, int flag)
 	static uint8_t passesPerStyle[] = {
 		0, 0, 1, 1, 1, 2, 2, 2, 1, 1
 	};
-	Border * border;
-	BoxF     borders;
-	REAL     shape[16], inner[16], poly[6];
-	int      i, j, merge, pass, passes;
+	Border *   border;
+	BoxF       borders;
+	REAL       shape[16], inner[16], poly[6];
+	int        i, j, merge, pass, passes;
+	ShapeCache cache = NULL;
 
 	if (box == NULL) box = &node->layout.pos;
 	borders = node->layout.border;
@@ -811,6 +979,28 @@ void renderBorder(SIT_Widget node, RectF * box, int flag)
 	if ((flag & 4) == 0) borders.bottom = 0;
 	if ((flag & 8) == 0) borders.left   = 0;
 
+	if (renderBorderRects(node, &borders, box))
+		return;
+
+	if ((node->layout.flags & LAYF_NoRoundBorder) == 0)
+	{
+		/* arcs are costly to tessellate: reuse what has been done for a border with same geometry/colors */
+		ShapeKey key;
+		memset(&key, 0, sizeof key);
+		key.type    = SHAPE_BORDER;
+		key.sides   = flag;
+		key.width   = box->width;
+		key.height  = box->height;
+		key.major   = node->layout.majorRadius;
+		key.minor   = node->layout.minorRadius;
+		key.border  = borders;
+		key.opacity = node->style.opacity;
+		for (i = 0, border = &node->style.borderTop; i < 4; i ++, border ++)
+			key.colors[i] = border->color.val, key.styles[i] = border->style;
+		if (renderReplayShape(&key, box->left, box->top, &cache))
+			return;
+	}
+
 	for (i = 0, border = &node->style.borderTop, passes = 0; i < 4; i ++, border ++)
 	{
 		pass = passesPerStyle[border->style];
@@ -980,6 +1170,7 @@ void renderBorder(SIT_Widget node, RectF * box, int flag)
 			merge &= ~0xff;
 		}
 	}
+	renderSaveShape(cache);
 }
 
 /* handle border-image */
@@ -1312,16 +1503,14 @@ static void renderFlushDeco(Decor * deco, REAL endX)
 	case TextDecoDouble:
 		nvgFillColorRGBA8(sit.nvgCtx, deco->color.rgba);
 		if (deco->type == 3) line.top -= thick;
-		renderRect(&line);
-		nvgFill(sit.nvgCtx);
+		nvgFillRect(sit.nvgCtx, line.left, line.top, line.width, line.height);
 		endX = 2.5f * thick;
 		if (deco->type == 1) line.top -= endX;
 		else line.top += endX;
 		/* no break; */
 	case TextDecoSolid:
 		nvgFillColorRGBA8(sit.nvgCtx, deco->color.rgba);
-		renderRect(&line);
-		nvgFill(sit.nvgCtx);
+		nvgFillRect(sit.nvgCtx, line.left, line.top, line.width, line.height);
 		break;
 	case TextDecoWavy: /* render a sine curve using the bezier control points: (0, 0) - (0.5, 0.5) - (1, 1) - (pi/2, 1) */
 	{	int  i, n;
@@ -1822,6 +2011,46 @@ int SIT_FrameRender(SIT_Widget w, APTR cd, APTR ud)
 	return 1;
 }
 
+/* draw cache: key of what has been recorded in node->drawCache */
+static void renderGetCacheKey(SIT_Widget node, RectF * box, REAL key[5])
+{
+	key[0] = box->width;
+	key[1] = box->height;
+	key[2] = node->layout.scrollLeft;
+	key[3] = node->layout.scrollTop;
+	key[4] = node->style.opacity;
+}
+
+static Bool renderReplayCache(SIT_Widget node, RectF * box)
+{
+	REAL key[5];
+
+	/* HTML tags are reused by list box for every cell */
+	if (node->drawCache == NULL || node->type == SIT_HTMLTAG || node->drawGen != sit.drawGen || sit.layerPass ||
+	    node->drawCRC != node->layout.curCRC32)
+		return False;
+
+	renderGetCacheKey(node, box, key);
+	if (memcmp(key, node->drawKey, sizeof key))
+		return False;
+
+	/* only a translation can be applied: content has to be re-tessellated otherwise */
+	return nvgReplay(sit.nvgCtx, node->drawCache, box->left, box->top);
+}
+
+static void renderRecordCache(SIT_Widget node, RectF * box)
+{
+	node->drawCache = nvgBeginRecord(sit.nvgCtx, node->drawCache, box->left, box->top);
+	renderGetCacheKey(node, box, node->drawKey);
+}
+
+static void renderSaveCache(SIT_Widget node)
+{
+	nvgEndRecord(sit.nvgCtx);
+	node->drawCRC = node->layout.curCRC32;
+	node->drawGen = sit.drawGen;
+}
+
 /* main rendering function: dispatching stub */
 static void renderNode(SIT_Widget node)
 {
@@ -1894,36 +2123,50 @@ static void renderNode(SIT_Widget node)
 		sit.compoCount ++;
 	}
 
-	if (node->layout.flags & LAYF_HasBoxShadow)  renderBoxShadow(node, &box, False);
-	if (node->style.background)                  renderBackground(node, &box, 15);
-	if (node->layout.flags & LAYF_HasInset)      renderBoxShadow(node, &box, True);
-	if (node->style.borderImg)                   renderBorderImg(node, &box, 15); else
-	if (! (node->layout.flags & LAYF_NoBorders)) renderBorder(node, &box, 15);
-	if (! (node->layout.flags & LAYF_NoOutline)) renderOutline(node, &box);
+	/* decoration and text: send what was tessellated last time if nothing changed */
+	Bool cached = renderReplayCache(node, &box);
+
+	if (! cached)
+	{
+		if (node->type != SIT_HTMLTAG && ! sit.layerPass)
+			renderRecordCache(node, &box);
+		if (node->layout.flags & LAYF_HasBoxShadow)  renderBoxShadow(node, &box, False);
+		if (node->style.background)                  renderBackground(node, &box, 15);
+		if (node->layout.flags & LAYF_HasInset)      renderBoxShadow(node, &box, True);
+		if (node->style.borderImg)                   renderBorderImg(node, &box, 15); else
+		if (! (node->layout.flags & LAYF_NoBorders)) renderBorder(node, &box, 15);
+		if (! (node->layout.flags & LAYF_NoOutline)) renderOutline(node, &box);
+	}
 
 	if (node->type == SIT_DIALOG)
 	{
 		box.left += node->style.font.size * 0.3f;
 		box.top  -= (pad[1] + node->style.font.size) * 0.5f;
 	}
-	if (node->layout.flags & LAYF_HasImg)
-	{
-		/* img.src not be confused with background-image */
-		CSSImage src = IMGLABEL(node);
-		nvgBeginPath(sit.nvgCtx);
-		pad[2] += pad[0];
-		pad[3] += pad[1];
-		nvgRect(sit.nvgCtx, box.left + pad[0], box.top + pad[1], box.width-pad[2], box.height-pad[3]);
-		nvgFillPaint(sit.nvgCtx, nvgImagePattern(sit.nvgCtx, box.left+pad[0], box.top+pad[1], box.width-pad[2], box.height-pad[3], 0, src->handle, 1));
-		nvgFill(sit.nvgCtx);
-	}
 
-	if ((node->layout.flags & LAYF_IgnoreWords) == 0)
+	if (! cached)
 	{
-		node->layout.flags |= LAYF_RenderWordBg;
-		if (node->style.shadowTotal > 0)
-			renderTextShadow(node, &box);
-		renderWords(node, &box, 0);
+		if (node->layout.flags & LAYF_HasImg)
+		{
+			/* img.src not be confused with background-image */
+			CSSImage src = IMGLABEL(node);
+			nvgBeginPath(sit.nvgCtx);
+			pad[2] += pad[0];
+			pad[3] += pad[1];
+			nvgRect(sit.nvgCtx, box.left + pad[0], box.top + pad[1], box.width-pad[2], box.height-pad[3]);
+			nvgFillPaint(sit.nvgCtx, nvgImagePattern(sit.nvgCtx, box.left+pad[0], box.top+pad[1], box.width-pad[2], box.height-pad[3], 0, src->handle, 1));
+			nvgFill(sit.nvgCtx);
+		}
+
+		if ((node->layout.flags & LAYF_IgnoreWords) == 0)
+		{
+			node->layout.flags |= LAYF_RenderWordBg;
+			if (node->style.shadowTotal > 0)
+				renderTextShadow(node, &box);
+			renderWords(node, &box, 0);
+		}
+		if (node->type != SIT_HTMLTAG && ! sit.layerPass)
+			renderSaveCache(node);
 	}
 
 	if (node->render)
@@ -1959,22 +2202,298 @@ static void renderNode(SIT_Widget node)
 	}
 }
 
+/* area on screen where a node can draw: border box, outline and box-shadow */
+static void renderGetExtent(SIT_Widget node, REAL rect[4])
+{
+	REAL grow = 2; /* antialiasing, text overhang */
+
+	if (! (node->layout.flags & LAYF_NoOutline))
+	{
+		REAL outline = node->layout.outlineWidth + node->layout.outlineOffset;
+		if (outline > 0) grow += outline;
+	}
+	if (node->layout.flags & LAYF_HasBoxShadow)
+	{
+		BoxShadow shadow;
+		REAL      max = 0;
+		int       i;
+		for (i = node->style.boxShadowCount, shadow = node->style.boxShadow; i > 0; i --, shadow ++)
+		{
+			if (shadow->inset) continue;
+			REAL ext = MAX(fabsf(shadow->XYSfloat[0]), fabsf(shadow->XYSfloat[1])) + shadow->XYSfloat[2] + shadow->blurFloat * 3;
+			if (max < ext) max = ext;
+		}
+		grow += max;
+	}
+	rect[0] = node->box.left   + node->offsetX + node->layout.left - grow;
+	rect[1] = node->box.top    + node->offsetY + node->layout.top  - grow;
+	rect[2] = node->box.right  + node->offsetX + node->layout.left + grow;
+	rect[3] = node->box.bottom + node->offsetY + node->layout.top  + grow;
+}
+
+/* check if rect overlaps screen, current scissor and area being redrawn */
+static Bool renderIsVisible(REAL rect[4])
+{
+	REAL clip[4];
+
+	if (rect[0] >= sit.scrWidth || rect[2] <= 0 || rect[1] >= sit.scrHeight || rect[3] <= 0)
+		return False;
+
+	if (sit.partialDraw)
+	{
+		int * area = sit.redrawArea;
+		if (rect[0] >= area[0] + area[2] || rect[2] <= area[0] || rect[1] >= area[1] + area[3] || rect[3] <= area[1])
+			return False;
+	}
+
+	if (nvgCurrentScissor(sit.nvgCtx, clip))
+		return rect[0] < clip[2] && rect[2] > clip[0] && rect[1] < clip[3] && rect[3] > clip[1];
+
+	return True;
+}
+
+static Bool renderCanCull(SIT_Widget node)
+{
+	/* layer content is rendered with a translation and kept while moving */
+	if (sit.layerPass) return False;
+	/* modal overlay covers the whole screen and composited areas must be reported */
+	return ! (node->composited || (node->type == SIT_DIALOG && (((SIT_Dialog)node)->customStyles & SITV_Modal)));
+}
+
+/* skip nodes that cannot draw anything visible */
+static Bool renderIsCulled(SIT_Widget node)
+{
+	REAL rect[4];
+
+	if (! renderCanCull(node))
+		return False;
+
+	renderGetExtent(node, rect);
+	return ! renderIsVisible(rect);
+}
+
+/* area covered by node and its children: cached until next geometry pass, relative to box (moving a dialog keeps it valid) */
+static void renderGetBounds(SIT_Widget node, REAL rect[4])
+{
+	REAL x = node->offsetX + node->box.left;
+	REAL y = node->offsetY + node->box.top;
+
+	if (node->boundsGen != sit.drawGen)
+	{
+		SIT_Widget c;
+		REAL       child[4];
+
+		renderGetExtent(node, rect);
+		/* private children are positioned and clipped by the widget itself */
+		if ((node->flags & SITF_PrivateChildren) == 0)
+		{
+			for (c = HEAD(node->children); c; NEXT(c))
+			{
+				if ((c->flags & SITF_TopLevel) || ! c->visible) continue;
+				renderGetBounds(c, child);
+				if (rect[0] > child[0]) rect[0] = child[0];
+				if (rect[1] > child[1]) rect[1] = child[1];
+				if (rect[2] < child[2]) rect[2] = child[2];
+				if (rect[3] < child[3]) rect[3] = child[3];
+			}
+		}
+		node->bounds[0] = rect[0] - x; node->bounds[2] = rect[2] - x;
+		node->bounds[1] = rect[1] - y; node->bounds[3] = rect[3] - y;
+		node->boundsGen = sit.drawGen;
+	}
+	else
+	{
+		rect[0] = node->bounds[0] + x; rect[2] = node->bounds[2] + x;
+		rect[1] = node->bounds[1] + y; rect[3] = node->bounds[3] + y;
+	}
+}
+
+/* only redraw area covered by this widget (SITV_RefreshDamaged), otherwise the whole interface */
+DLLIMP void SIT_RefreshWidget(SIT_Widget w)
+{
+	if (w == NULL)
+	{
+		sit.dirty = 1;
+		return;
+	}
+	SIT_Widget parent;
+	/* outline or box-shadow might have changed: bounds of subtrees containing this widget */
+	for (parent = w; parent && parent->boundsGen; parent = parent->parent)
+		parent->boundsGen = 0;
+	if (sit.layerCount > 0)
+	{
+		/* layers containing this widget will have to be rendered again */
+		for (parent = w; parent; parent = parent->parent)
+			if (parent->layer) parent->layerGen = 0;
+	}
+	if (sit.refreshMode != SITV_RefreshDamaged)
+	{
+		/* redraw everything, but this change is known to only affect <w> */
+		sit.dirty |= 2;
+		return;
+	}
+	if (! w->visible || sit.dirty) return;
+
+	REAL rect[4];
+	renderGetExtent(w, rect);
+	if (sit.damage[0] < sit.damage[2])
+	{
+		if (sit.damage[0] > rect[0]) sit.damage[0] = rect[0];
+		if (sit.damage[1] > rect[1]) sit.damage[1] = rect[1];
+		if (sit.damage[2] < rect[2]) sit.damage[2] = rect[2];
+		if (sit.damage[3] < rect[3]) sit.damage[3] = rect[3];
+	}
+	else memcpy(sit.damage, rect, sizeof rect);
+}
+
+/* layer: area covered by subtree, aligned on pixel boundaries */
+static void renderGetLayerRect(SIT_Widget node, int rect[4])
+{
+	REAL extent[4];
+	renderGetExtent(node, extent);
+	rect[0] = floorf(extent[0]);
+	rect[1] = floorf(extent[1]);
+	rect[2] = ceilf(extent[2]) - rect[0];
+	rect[3] = ceilf(extent[3]) - rect[1];
+}
+
+/* render subtree in its offscreen buffer */
+static void renderLayer(SIT_Widget node, int rect[4])
+{
+	NVGLUframebuffer * fb = node->layerFBO;
+	NVGCTX vg = sit.nvgCtx;
+	GLint  viewport[4];
+	float  clear[4];
+
+	if (fb)
+	{
+		int w, h;
+		nvgImageSize(vg, fb->image, &w, &h);
+		if (w != rect[2] || h != rect[3])
+			nvgluDeleteFramebuffer(fb), fb = NULL;
+	}
+	/* not worth it if too big: will be rendered as usual */
+	if (fb == NULL && rect[2] > 0 && rect[3] > 0 && rect[2] <= sit.scrWidth && rect[3] <= sit.scrHeight)
+		fb = nvgluCreateFramebuffer(vg, rect[2], rect[3], 0);
+	node->layerFBO = fb;
+	if (fb == NULL) return;
+
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	glGetFloatv(GL_COLOR_CLEAR_VALUE, clear);
+	nvgluBindFramebuffer(fb);
+	glViewport(0, 0, rect[2], rect[3]);
+	glClearColor(0, 0, 0, 0);
+	glClear(GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+
+	nvgBeginFrame(vg, rect[2], rect[3], 1);
+	nvgTranslate(vg, -rect[0], -rect[1]);
+	sit.layerPass = node;
+	SIT_RenderNode(node);
+	sit.layerPass = NULL;
+	nvgEndFrame(vg);
+
+	nvgluBindFramebuffer(NULL);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	glClearColor(clear[0], clear[1], clear[2], clear[3]);
+	node->layerGen = sit.drawGen;
+}
+
+/* render layers whose content has changed, nested ones first; return True if subtree has composited nodes */
+static Bool renderUpdateLayers(SIT_Widget root, Bool all)
+{
+	SIT_Widget c;
+	Bool hasCompo = False;
+	for (c = HEAD(root->children); c; NEXT(c))
+	{
+		if (! c->visible) continue;
+		/* composited node must report its area on each frame: cannot be part of a cached quad */
+		Bool compo = c->composited != 0;
+		if (c->children.lh_Head && renderUpdateLayers(c, all))
+			compo = True;
+		if (c->layer && ! (c->flags & SITF_TopLevel))
+		{
+			if (compo)
+			{
+				if (c->layerFBO)
+					nvgluDeleteFramebuffer(c->layerFBO), c->layerFBO = NULL;
+			}
+			else
+			{
+				int rect[4];
+				renderGetLayerRect(c, rect);
+				if (all || c->layerGen != sit.drawGen || c->layerFBO == NULL)
+					renderLayer(c, rect);
+			}
+		}
+		/* top level children are not part of the layer of their parent */
+		if (compo && ! (c->flags & SITF_TopLevel))
+			hasCompo = True;
+	}
+	return hasCompo;
+}
+
+/* draw content of layer as a single textured quad */
+static Bool renderLayerQuad(SIT_Widget node)
+{
+	NVGLUframebuffer * fb = node->layerFBO;
+	NVGCTX vg = sit.nvgCtx;
+	int    rect[4], w, h;
+
+	if (fb == NULL || node->layerGen != sit.drawGen || sit.layerPass == node)
+		return False;
+
+	renderGetLayerRect(node, rect);
+	nvgImageSize(vg, fb->image, &w, &h);
+	if (w != rect[2] || h != rect[3])
+		return False;
+
+	nvgGlobalAlpha(vg, 1);
+	nvgBeginPath(vg);
+	nvgRect(vg, rect[0], rect[1], w, h);
+	nvgFillPaint(vg, nvgImagePattern(vg, rect[0], rect[1], w, h, 0, fb->image, 1));
+	nvgFill(vg);
+	return True;
+}
+
+void SIT_FreeLayer(SIT_Widget node)
+{
+	if (node->layerFBO)
+		nvgluDeleteFramebuffer(node->layerFBO), node->layerFBO = NULL;
+	sit.layerCount --;
+}
+
 DLLIMP void SIT_RenderNode(SIT_Widget root)
 {
 	SIT_Widget c;
 
-	renderNode(root);
+	if (root->layer && renderLayerQuad(root))
+		goto toplevel;
+
+	/* nothing visible in the whole subtree (list box reuses HTML tags for its cells: no cache for them) */
+	if (root->type != SIT_HTMLTAG && renderCanCull(root))
+	{
+		REAL rect[4];
+		renderGetBounds(root, rect);
+		if (! renderIsVisible(rect))
+			goto toplevel;
+	}
+
+	if (! renderIsCulled(root))
+		renderNode(root);
 
 	/* children first */
 	for (c = HEAD(root->children); c; NEXT(c))
 	{
 		if ((c->flags & SITF_TopLevel) || ! c->visible) continue;
-		if ((c->flags & SITF_RenderChildren) && c->children.lh_Head)
+		if (((c->flags & SITF_RenderChildren) && c->children.lh_Head) || c->layer)
 			SIT_RenderNode(c);
-		else
+		else if (! renderIsCulled(c))
 			renderNode(c);
 	}
 
+	toplevel:
+	if (sit.layerPass == root) return;
+
 	/* top level next */
 	for (c = HEAD(root->children); c; NEXT(c))
 	{
@@ -2003,16 +2522,18 @@ DLLIMP SIT_RENDER SIT_RenderNodes(double time)
 	if (sit.nextAction <= time)
 		SIT_ActionDispatch(time);
 
+	sit.layoutCount = 0;
 	if (sit.geomList)
 	{
 		SIT_Widget list = sit.geomList;
 		sit.geomList = NULL;
 		SIT_ReflowLayout(list);
 		sit.dirty = 1;
+		sit.drawGen ++;
 	}
 
 	if (sit.root->flags & SITF_GeometryChanged)
-		SIT_LayoutWidgets(sit.root, FitUsingCurrentBox);
+		SIT_LayoutWidgets(sit.root, FitUsingCurrentBox), sit.drawGen ++;
 
 	while (sit.pendingDel.lh_Head)
 	{
@@ -2024,17 +2545,63 @@ DLLIMP SIT_RENDER SIT_RenderNodes(double time)
 	sit.root->visible = 1;
 	sit.curTime = time;
 
-	if (sit.refreshMode == SITV_RefreshAsNeeded && ! sit.dirty)
+	int * area = sit.redrawArea;
+	if (sit.refreshMode == SITV_RefreshDamaged && ! sit.dirty)
+	{
+		if (sit.damage[0] >= sit.damage[2])
+			return SIT_RenderNothing;
+
+		/* only redraw what has changed, keep the rest of the back buffer */
+		area[0] = MAX(floorf(sit.damage[0]), 0);
+		area[1] = MAX(floorf(sit.damage[1]), 0);
+		area[2] = MIN(ceilf(sit.damage[2]), sit.scrWidth)  - area[0];
+		area[3] = MIN(ceilf(sit.damage[3]), sit.scrHeight) - area[1];
+		memset(sit.damage, 0, sizeof sit.damage);
+		if (area[2] <= 0 || area[3] <= 0)
+			return SIT_RenderNothing;
+		sit.partialDraw = 1;
+	}
+	else if (sit.refreshMode == SITV_RefreshAsNeeded && ! sit.dirty)
+	{
 		return SIT_RenderNothing;
+	}
+	else
+	{
+		area[0] = area[1] = 0;
+		area[2] = sit.scrWidth;
+		area[3] = sit.scrHeight;
+		memset(sit.damage, 0, sizeof sit.damage);
+	}
+
+	/* content of layers: drawn before main frame (cannot switch framebuffer within a frame) */
+	if (sit.layerCount > 0)
+		renderUpdateLayers(sit.root, sit.dirty & 1);
 
 	sit.dirty = False;
 
-	glClear(GL_STENCIL_BUFFER_BIT);
+	if (sit.partialDraw)
+	{
+		/* OpenGL origin is bottom left */
+		glEnable(GL_SCISSOR_TEST);
+		glScissor(area[0], sit.scrHeight - area[1] - area[3], area[2], area[3]);
+		glClear(GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+		/* nanovg disables scissor test when flushing: everything overlapping area would be drawn in full */
+		nvgluKeepScissor(sit.nvgCtx, 1);
+	}
+	else glClear(GL_STENCIL_BUFFER_BIT);
+
 	nvgBeginFrame(sit.nvgCtx, sit.scrWidth, sit.scrHeight, 1);
 
 	SIT_RenderNode(sit.root);
 
 	nvgEndFrame(sit.nvgCtx);
 
+	if (sit.partialDraw)
+	{
+		nvgluKeepScissor(sit.nvgCtx, 0);
+		glDisable(GL_SCISSOR_TEST);
+		sit.partialDraw = 0;
+	}
+
 	return sit.composited ? SIT_RenderComposite : SIT_RenderDone;
 }
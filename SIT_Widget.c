@@ -6,6 +6,7 @@
 
 #include "platform.h"
 #include <stdlib.h>
+#include <malloc.h>
 #include <string.h>
 #include <stdarg.h>
 #include <math.h>
@@ -73,6 +74,9 @@
 		{ "maxBoxHeight",     SIT_MaxBoxHeight,     CSG, SIT_UNIT, OFFSET(SIT_Widget, maxBox.height) },
 		#undef ATTACH
 
+		/* tags below are not looked up by position */
+		{ "layer",            SIT_Layer,            _SG, SIT_BOOL, 0 },
+
 		{ SIT_TagEnd }
 	};
 
@@ -207,12 +211,23 @@ int SIT_SetWidgetValue(SIT_Widget w, APTR cd, APTR ud)
 		if (w->flags & SITF_InitDone)
 		{
 			w->layout.wordwrap.count = 0;
+			w->layout.lines.count = 0;
+			w->drawGen = 0;
 			layoutParseHTML(w, w->title);
 		}
 		break;
 	case SIT_Composited:
 		w->composited = val->boolean;
 		break;
+	case SIT_Layer:
+		if (w->layer != val->boolean)
+		{
+			if (w->layer) SIT_FreeLayer(w);
+			else sit.layerCount ++;
+			w->layer = val->boolean;
+			sit.dirty = 1;
+		}
+		break;
 	case SIT_Visible:
 		w->layout.flags |= LAYF_VisibleChanged;
 		if (w->type == SIT_TOOLTIP)
@@ -239,11 +254,14 @@ int SIT_SetWidgetValue(SIT_Widget w, APTR cd, APTR ud)
 		break;
 	case SIT_Classes:
 		w->flags |= SITF_RecalcStyles | SITF_CustomClasses;
+		cssSetAtoms(w);
 		memset(w->layout.crc32, 0xff, sizeof w->layout.crc32);
 		break;
 	case SIT_Style:
 		w->flags |= SITF_RecalcStyles;
 		memset(w->layout.crc32, 0xff, sizeof w->layout.crc32);
+		/* inline styles are part of fingerprint through their address, which can be reused */
+		w->layout.curCRC32 = -1;
 		/* note: val->string is a direct pointer from user, might be a static string at this point */
 		cssParseInlineStyles(w, val->string);
 		break;
@@ -327,6 +345,7 @@ static void SIT_SplitName(SIT_Widget w)
 	w->classes = cls;
 	if (state && strcasecmp(state, "active") == 0)
 		w->state = STATE_ACTIVATED;
+	cssSetAtoms(w);
 }
 
 /* canvas: too simple to have its dedicated file */
@@ -903,6 +922,13 @@ void SIT_FreeCSS(SIT_Widget node)
 	if (node->style.borderImg)   free(node->style.borderImg);
 	if (node->layout.wordwrap.buffer)
 		free(node->layout.wordwrap.buffer);
+	if (node->layout.lines.buffer)
+		free(node->layout.lines.buffer), memset(&node->layout.lines, 0, sizeof node->layout.lines);
+	if (node->drawCache)
+		nvgDeleteRecord(node->drawCache), node->drawCache = NULL;
+	if (node->classAtoms)
+		free(node->classAtoms), node->classAtoms = NULL;
+	node->atomTag = NULL;
 }
 
 static void SIT_RemoveFromFocus(SIT_Widget w)
@@ -953,6 +979,14 @@ void SIT_DestroyWidget(SIT_Widget w)
 		for (prev = &sit.geomList, list = *prev; list && list != w; prev = &list->geomChanged, list = *prev);
 		if (list) *prev = list->geomChanged;
 	}
+	if (sit.updateCount > 0)
+	{
+		/* might be waiting for SIT_EndUpdate() (flag can be cleared by a restyle of a parent) */
+		SIT_Widget * pending;
+		int          i;
+		for (i = sit.pendingStyles.count, pending = vector_first(sit.pendingStyles); i > 0; i --, pending ++)
+			if (*pending == w) *pending = NULL;
+	}
 	if (w->flags & SITF_CustomClasses)
 		free(w->classes);
 
@@ -1018,6 +1052,8 @@ void SIT_DestroyWidget(SIT_Widget w)
 		ListRemove(&parent->children, &w->node);
 	}
 
+	if (w->layer)
+		SIT_FreeLayer(w);
 	SIT_FreeCSS(w);
 	free(w);
 }
@@ -1100,6 +1136,7 @@ void SIT_InitiateReflow(SIT_Widget w)
 		}
 	}
 	w->flags |= SITF_GeomNotified;
+	w->measureGen = 0;
 	w->geomChanged = sit.geomList;
 	sit.geomList = w;
 }
@@ -1132,13 +1169,22 @@ DLLIMP void SIT_SetValues(SIT_Widget w, ...)
 
 	if (w->flags & SITF_RecalcStyles)
 	{
-		layoutUpdateStyles(w);
-		w->flags &= ~SITF_RecalcStyles;
+		if (sit.updateCount > 0)
+		{
+			/* will be done in SIT_EndUpdate() */
+			SIT_DelayStyles(w);
+		}
+		else
+		{
+			layoutUpdateStyles(w);
+			w->flags &= ~SITF_RecalcStyles;
+		}
 	}
 
 	/* check for geometry changes */
 	if (w->flags & SITF_GeometryChanged)
 	{
+		w->measureGen = 0;
 		if (w->type == SIT_HTMLTAG)
 			layoutSetSize(w);
 		else
@@ -1148,6 +1194,75 @@ DLLIMP void SIT_SetValues(SIT_Widget w, ...)
 	}
 }
 
+/* restyle requested within SIT_BeginUpdate()/SIT_EndUpdate() */
+void SIT_DelayStyles(SIT_Widget w)
+{
+	SIT_Widget * pending = vector_nth(&sit.pendingStyles, sit.pendingStyles.count);
+	/* state might have changed: force a full recalc */
+	w->flags |= SITF_RecalcStyles;
+	*pending = w;
+}
+
+/* group several SIT_SetValues(): styles and geometry will only be recomputed once in SIT_EndUpdate() */
+DLLIMP void SIT_BeginUpdate(void)
+{
+	if (sit.updateCount ++ == 0)
+		vector_init(sit.pendingStyles, sizeof (SIT_Widget));
+}
+
+DLLIMP void SIT_EndUpdate(void)
+{
+	SIT_Widget * pending;
+	SIT_Widget * dialogs;
+	SIT_Widget   list, next;
+	int          i, count;
+
+	if (sit.updateCount == 0 || -- sit.updateCount > 0)
+		return;
+
+	/* widgets can be listed several times, but will be restyled only once */
+	for (i = sit.pendingStyles.count, pending = vector_first(sit.pendingStyles); i > 0; i --, pending ++)
+	{
+		list = *pending;
+		if (list && (list->flags & SITF_RecalcStyles))
+		{
+			layoutUpdateStyles(list);
+			list->flags &= ~SITF_RecalcStyles;
+		}
+	}
+	vector_free(sit.pendingStyles);
+	memset(&sit.pendingStyles, 0, sizeof sit.pendingStyles);
+
+	/* only one geometry change: SIT_ReflowLayout() will only check its neighbors */
+	if (sit.geomList == NULL || sit.geomList->geomChanged == NULL)
+		return;
+
+	for (list = sit.geomList, count = 0; list; list = list->geomChanged, count ++);
+	dialogs = alloca(count * sizeof *dialogs);
+
+	/* otherwise do a full layout of each dialog that has been modified */
+	for (list = sit.geomList, sit.geomList = NULL, count = 0; list; list = next)
+	{
+		SIT_Widget top;
+		next = list->geomChanged;
+		list->geomChanged = NULL;
+		list->flags &= ~SITF_GeomNotified;
+		if (list->optimalWidth)
+			list->optimalBox.width = -1;
+		for (top = list; top->parent && (top->flags & SITF_TopLevel) == 0; top = top->parent)
+			memset(&top->parent->childBox, 0, sizeof top->childBox);
+		for (i = 0; i < count && dialogs[i] != top; i ++);
+		if (i == count) dialogs[count++] = top;
+	}
+	for (i = 0; i < count; i ++)
+		SIT_LayoutWidgets(dialogs[i], dialogs[i]->parent ? KeepDialogSize : FitUsingCurrentBox);
+	if (count > 0)
+		sit.drawGen ++;
+
+	SIT_ProcessMouseMove(sit.mouseX, sit.mouseY);
+	sit.dirty = 1;
+}
+
 DLLIMP void SIT_GetValues(SIT_Widget w, ...)
 {
 	va_list vargs;
@@ -1242,6 +1357,15 @@ DLLIMP void SIT_GetValues(SIT_Widget w, ...)
 				case SIT_CompositedAreas:
 					va_arg(vargs, DATA8 *)[0] = sit.compoIds;
 					continue;
+				case SIT_Layer:
+					va_arg(vargs, Bool *)[0] = w->layer;
+					continue;
+				case SIT_LayoutCount:
+					*va_arg(vargs, int *) = sit.layoutCount;
+					continue;
+				case SIT_RedrawArea:
+					memcpy(va_arg(vargs, int *), sit.redrawArea, sizeof sit.redrawArea);
+					continue;
 				/* yeah, virtual functions would be better, but there are too few properties that require special processing */
 				case SIT_SelectedIndex:
 					if (w->type == SIT_LISTBOX)
@@ -50,6 +50,8 @@
 #define NVG_INIT_PATHS_SIZE 16
 #define NVG_INIT_VERTS_SIZE 256
 #define NVG_MAX_STATES 32
+#define NVG_TEXTCACHE_SETS 256	// Text width cache: sets must be a power of 2, LRU replacement within a set.
+#define NVG_TEXTCACHE_WAYS 4
 
 #define NVG_KAPPA90 0.5522847493f	// Length proportional to radius of a cubic bezier handle for 90deg arcs.
 
@@ -102,6 +104,55 @@ struct NVGpoint {
 };
 typedef struct NVGpoint NVGpoint;
 
+struct NVGtextWidth {
+	unsigned long long hash;
+	int len;
+	int fontId;
+	float fontSize;
+	float letterSpacing;
+	float width;
+};
+typedef struct NVGtextWidth NVGtextWidth;
+
+enum NVGrecordType {
+	NVG_RECORD_FILL,
+	NVG_RECORD_STROKE,
+	NVG_RECORD_TRIANGLES,
+};
+
+struct NVGrecordCall {
+	int type;
+	NVGpaint paint;
+	NVGcompositeOperationState compositeOperation;
+	NVGscissor scissor;
+	int inheritScissor;		// scissor was the one active in nvgBeginRecord()
+	float fringe;
+	float strokeWidth;
+	float bounds[4];
+	int first, count;		// paths for fill/stroke, vertices for triangles
+	int vertex;				// first vertex of paths
+};
+typedef struct NVGrecordCall NVGrecordCall;
+
+struct NVGrecord {
+	NVGrecordCall* calls;
+	int ncalls;
+	int ccalls;
+	NVGpath* paths;
+	int npaths;
+	int cpaths;
+	NVGvertex* verts;
+	int nverts;
+	int cverts;
+	NVGscissor scissor;		// active when recording started
+	float x, y;				// reference point of content
+	int atlasGen;			// font atlas used by text
+	int hasText;
+	int ownScissor;			// some calls use a scissor set within the record
+	int valid;
+	NVGrecord* parent;		// record active when this one started
+};
+
 struct NVGpathCache {
 	NVGpoint* points;
 	int npoints;
@@ -137,6 +188,9 @@ struct NVGcontext {
 	int strokeTriCount;
 	int textTriCount;
 	int beginCall;
+	int atlasGen;
+	NVGrecord* record;
+	NVGtextWidth textCache[NVG_TEXTCACHE_SETS][NVG_TEXTCACHE_WAYS];
 };
 
 static float nvg__sqrtf(float a) { return sqrtf(a); }
@@ -1103,6 +1157,24 @@ DLLIMP void nvgResetScissor(NVGcontext* ctx)
 	state->scissor.extent[1] = -1.0f;
 }
 
+DLLIMP int nvgCurrentScissor(NVGcontext* ctx, float* bounds)
+{
+	NVGstate* state = nvg__getState(ctx);
+	float* xform = state->scissor.xform;
+	float* extent = state->scissor.extent;
+	float ex, ey;
+
+	if (extent[0] < 0) return 0;
+
+	ex = nvg__absf(xform[0])*extent[0] + nvg__absf(xform[2])*extent[1];
+	ey = nvg__absf(xform[1])*extent[0] + nvg__absf(xform[3])*extent[1];
+	bounds[0] = xform[4] - ex;
+	bounds[1] = xform[5] - ey;
+	bounds[2] = xform[4] + ex;
+	bounds[3] = xform[5] + ey;
+	return 1;
+}
+
 // Global composite operation.
 DLLIMP void nvgGlobalCompositeOperation(NVGcontext* ctx, int op)
 {
@@ -2365,6 +2437,196 @@ void nvgDebugDumpPathCache(NVGcontext* ctx)
 }
 #endif
 
+static int nvg__recordReserve(void** buf, int* cap, int count, int size)
+{
+	if (count > *cap) {
+		int n = nvg__maxi(count, *cap * 2);
+		void* mem = realloc(*buf, n * size);
+		if (mem == NULL) return 0;
+		*buf = mem;
+		*cap = n;
+	}
+	return 1;
+}
+
+static void nvg__recordCall(NVGcontext* ctx, int type, NVGpaint* paint, NVGscissor* scissor, float strokeWidth, const float* bounds, const NVGpath* paths, int npaths, const NVGvertex* verts, int nverts)
+{
+	NVGstate* state = nvg__getState(ctx);
+	NVGrecord* rec;
+	NVGrecordCall* call;
+	int i;
+
+	if (type != NVG_RECORD_TRIANGLES) {
+		// vertices are stored consecutively: fill then stroke of each path
+		for (i = 0; i < npaths; i++)
+			nverts += paths[i].nfill + paths[i].nstroke;
+	}
+
+	for (rec = ctx->record; rec; rec = rec->parent) {
+		if (!rec->valid) continue;
+		if (!nvg__recordReserve((void**)&rec->calls, &rec->ccalls, rec->ncalls+1, sizeof(NVGrecordCall)) ||
+			!nvg__recordReserve((void**)&rec->paths, &rec->cpaths, rec->npaths+npaths, sizeof(NVGpath)) ||
+			!nvg__recordReserve((void**)&rec->verts, &rec->cverts, rec->nverts+nverts, sizeof(NVGvertex))) {
+			rec->valid = 0;
+			continue;
+		}
+
+		call = &rec->calls[rec->ncalls++];
+		call->type = type;
+		call->paint = *paint;
+		call->compositeOperation = state->compositeOperation;
+		call->scissor = *scissor;
+		call->inheritScissor = memcmp(scissor, &rec->scissor, sizeof(NVGscissor)) == 0;
+		call->fringe = ctx->fringeWidth;
+		call->strokeWidth = strokeWidth;
+		memcpy(call->bounds, bounds, sizeof(call->bounds));
+		if (!call->inheritScissor)
+			rec->ownScissor = 1;
+
+		if (type == NVG_RECORD_TRIANGLES) {
+			call->first = call->vertex = rec->nverts;
+			call->count = nverts;
+			memcpy(rec->verts + rec->nverts, verts, nverts * sizeof(NVGvertex));
+			rec->nverts += nverts;
+			rec->hasText = 1;
+		} else {
+			call->first = rec->npaths;
+			call->count = npaths;
+			call->vertex = rec->nverts;
+			for (i = 0; i < npaths; i++) {
+				const NVGpath* path = &paths[i];
+				rec->paths[rec->npaths++] = *path;
+				memcpy(rec->verts + rec->nverts, path->fill, path->nfill * sizeof(NVGvertex));
+				rec->nverts += path->nfill;
+				memcpy(rec->verts + rec->nverts, path->stroke, path->nstroke * sizeof(NVGvertex));
+				rec->nverts += path->nstroke;
+			}
+		}
+	}
+}
+
+static void nvg__translateXform(float* xform, float dx, float dy)
+{
+	xform[4] += dx;
+	xform[5] += dy;
+}
+
+DLLIMP NVGrecord* nvgBeginRecord(NVGcontext* ctx, NVGrecord* rec, float x, float y)
+{
+	if (rec == NULL) {
+		rec = (NVGrecord*)malloc(sizeof(NVGrecord));
+		if (rec == NULL) return NULL;
+		memset(rec, 0, sizeof(NVGrecord));
+	}
+	rec->ncalls = rec->npaths = rec->nverts = 0;
+	rec->scissor = nvg__getState(ctx)->scissor;
+	rec->x = x;
+	rec->y = y;
+	rec->atlasGen = ctx->atlasGen;
+	rec->hasText = 0;
+	rec->ownScissor = 0;
+	rec->valid = 1;
+	rec->parent = ctx->record;
+	ctx->record = rec;
+	return rec;
+}
+
+DLLIMP void nvgEndRecord(NVGcontext* ctx)
+{
+	NVGrecord* rec = ctx->record;
+	NVGvertex* verts;
+	int i, j;
+	if (rec == NULL) return;
+	ctx->record = rec->parent;
+	rec->parent = NULL;
+
+	// vertex buffer will not move anymore: point paths to it
+	for (i = 0; i < rec->ncalls; i++) {
+		NVGrecordCall* call = &rec->calls[i];
+		if (call->type == NVG_RECORD_TRIANGLES) continue;
+		for (j = 0, verts = rec->verts + call->vertex; j < call->count; j++) {
+			NVGpath* path = &rec->paths[call->first+j];
+			path->fill = verts;   verts += path->nfill;
+			path->stroke = verts; verts += path->nstroke;
+		}
+	}
+}
+
+DLLIMP int nvgReplay(NVGcontext* ctx, NVGrecord* rec, float x, float y)
+{
+	NVGstate* state = nvg__getState(ctx);
+	NVGrecord* active;
+	float dx, dy;
+	int i;
+
+	if (rec == NULL || !rec->valid) return 0;
+	for (active = ctx->record; active; active = active->parent)
+		if (active == rec) return 0;
+	if (rec->hasText && rec->atlasGen != ctx->atlasGen) return 0;
+
+	dx = x - rec->x;
+	dy = y - rec->y;
+	if (dx != 0 || dy != 0) {
+		// apply translation on recorded data, next replay at same position will be free
+		for (i = 0; i < rec->nverts; i++) {
+			rec->verts[i].x += dx;
+			rec->verts[i].y += dy;
+		}
+		for (i = 0; i < rec->ncalls; i++) {
+			NVGrecordCall* call = &rec->calls[i];
+			nvg__translateXform(call->paint.xform, dx, dy);
+			nvg__translateXform(call->scissor.xform, dx, dy);
+			call->bounds[0] += dx; call->bounds[2] += dx;
+			call->bounds[1] += dy; call->bounds[3] += dy;
+		}
+		nvg__translateXform(rec->scissor.xform, dx, dy);
+		rec->x = x;
+		rec->y = y;
+	}
+
+	// scissors set within record were intersected with the one active when it started
+	if (rec->ownScissor && memcmp(&rec->scissor, &state->scissor, sizeof(NVGscissor)))
+		return 0;
+
+	for (i = 0; i < rec->ncalls; i++) {
+		NVGrecordCall* call = &rec->calls[i];
+		NVGscissor* scissor = call->inheritScissor ? &state->scissor : &call->scissor;
+		switch (call->type) {
+		case NVG_RECORD_FILL:
+			ctx->params.renderFill(ctx->params.userPtr, &call->paint, call->compositeOperation, scissor, call->fringe,
+								   call->bounds, rec->paths + call->first, call->count);
+			ctx->drawCallCount += call->count * 2;
+			break;
+		case NVG_RECORD_STROKE:
+			ctx->params.renderStroke(ctx->params.userPtr, &call->paint, call->compositeOperation, scissor, call->fringe,
+									 call->strokeWidth, rec->paths + call->first, call->count);
+			ctx->drawCallCount += call->count;
+			break;
+		case NVG_RECORD_TRIANGLES:
+			ctx->params.renderTriangles(ctx->params.userPtr, &call->paint, call->compositeOperation, scissor,
+										rec->verts + call->first, call->count, call->fringe);
+			ctx->drawCallCount++;
+		}
+		// replayed within another record: keep a copy there too
+		if (ctx->record) {
+			if (call->type == NVG_RECORD_TRIANGLES)
+				nvg__recordCall(ctx, call->type, &call->paint, scissor, 0, call->bounds, NULL, 0, rec->verts + call->first, call->count);
+			else
+				nvg__recordCall(ctx, call->type, &call->paint, scissor, call->strokeWidth, call->bounds, rec->paths + call->first, call->count, NULL, 0);
+		}
+	}
+	return 1;
+}
+
+DLLIMP void nvgDeleteRecord(NVGrecord* rec)
+{
+	if (rec == NULL) return;
+	free(rec->calls);
+	free(rec->paths);
+	free(rec->verts);
+	free(rec);
+}
+
 DLLIMP void nvgFill(NVGcontext* ctx)
 {
 	NVGstate* state = nvg__getState(ctx);
@@ -2384,6 +2646,8 @@ DLLIMP void nvgFill(NVGcontext* ctx)
 
 	ctx->params.renderFill(ctx->params.userPtr, &fillPaint, state->compositeOperation, &state->scissor, ctx->fringeWidth,
 						   ctx->cache->bounds, ctx->cache->paths, ctx->cache->npaths);
+	if (ctx->record)
+		nvg__recordCall(ctx, NVG_RECORD_FILL, &fillPaint, &state->scissor, 0, ctx->cache->bounds, ctx->cache->paths, ctx->cache->npaths, NULL, 0);
 
 	// Count triangles
 	for (i = 0; i < ctx->cache->npaths; i++) {
@@ -2394,6 +2658,107 @@ DLLIMP void nvgFill(NVGcontext* ctx)
 	}
 }
 
+static int nvg__isPixelAligned(float v, float ratio)
+{
+	v *= ratio;
+	return nvg__absf(v - floorf(v + 0.5f)) < 0.01f;
+}
+
+DLLIMP void nvgFillRect(NVGcontext* ctx, float x, float y, float w, float h)
+{
+	NVGstate* state = nvg__getState(ctx);
+	NVGpaint fillPaint = state->fill;
+	float* t = state->xform;
+	float ratio = 1.0f / ctx->fringeWidth;
+	float woff = 0.5f * ctx->fringeWidth;
+	float bounds[4];
+	NVGvertex* verts;
+	NVGvertex* dst;
+	NVGpath path;
+	int i;
+
+	if (t[1] != 0.0f || t[2] != 0.0f) {
+		// Rotated: go through a regular path, but keep the current one.
+		float* commands = ctx->commands;
+		int ncommands = ctx->ncommands, ccommands = ctx->ccommands;
+		float commandx = ctx->commandx, commandy = ctx->commandy;
+		ctx->commands = NULL;
+		ctx->ncommands = ctx->ccommands = 0;
+		nvg__clearPathCache(ctx);
+		nvgRect(ctx, x, y, w, h);
+		nvgFill(ctx);
+		free(ctx->commands);
+		ctx->commands = commands;
+		ctx->ncommands = ncommands;
+		ctx->ccommands = ccommands;
+		ctx->commandx = commandx;
+		ctx->commandy = commandy;
+		// Current path will be flattened again
+		nvg__clearPathCache(ctx);
+		return;
+	}
+
+	bounds[0] = t[0]*x + t[4];
+	bounds[1] = t[3]*y + t[5];
+	bounds[2] = t[0]*(x+w) + t[4];
+	bounds[3] = t[3]*(y+h) + t[5];
+	if (bounds[0] > bounds[2]) { float tmp = bounds[0]; bounds[0] = bounds[2]; bounds[2] = tmp; }
+	if (bounds[1] > bounds[3]) { float tmp = bounds[1]; bounds[1] = bounds[3]; bounds[3] = tmp; }
+	if (bounds[2] - bounds[0] <= 0 || bounds[3] - bounds[1] <= 0) return;
+
+	verts = nvg__allocTempVerts(ctx, 4 + 10);
+	if (verts == NULL) return;
+
+	memset(&path, 0, sizeof(path));
+	path.winding = NVG_CCW;
+	path.closed = 1;
+	path.convex = 1;
+	path.count = 4;
+	path.fill = dst = verts;
+
+	if (!ctx->params.edgeAntiAlias || !state->shapeAntiAlias ||
+		(nvg__isPixelAligned(bounds[0], ratio) && nvg__isPixelAligned(bounds[1], ratio) &&
+		 nvg__isPixelAligned(bounds[2], ratio) && nvg__isPixelAligned(bounds[3], ratio))) {
+		// Edges fall on pixel boundaries: no fringe needed
+		woff = 0;
+	}
+
+	// Same vertices and order as nvgRect() + nvgFill(): inset by half a fringe.
+	nvg__vset(dst++, bounds[0]+woff, bounds[1]+woff, 0.5f,1);
+	nvg__vset(dst++, bounds[0]+woff, bounds[3]-woff, 0.5f,1);
+	nvg__vset(dst++, bounds[2]-woff, bounds[3]-woff, 0.5f,1);
+	nvg__vset(dst++, bounds[2]-woff, bounds[1]+woff, 0.5f,1);
+	path.nfill = 4;
+
+	if (woff > 0) {
+		// Half fringe, from inset (opaque) to outset (transparent)
+		path.stroke = dst;
+		for (i = 0; i < 4; i++) {
+			float dx = verts[i].x < (bounds[0]+bounds[2])*0.5f ? -woff : woff;
+			float dy = verts[i].y < (bounds[1]+bounds[3])*0.5f ? -woff : woff;
+			nvg__vset(dst++, verts[i].x, verts[i].y, 0.5f,1);
+			nvg__vset(dst++, verts[i].x + dx*2, verts[i].y + dy*2, 1,1);
+		}
+		nvg__vset(dst++, verts[0].x, verts[0].y, 0.5f,1);
+		nvg__vset(dst++, verts[0].x - woff*2, verts[0].y - woff*2, 1,1);
+		path.nstroke = 10;
+	}
+
+	// Apply global alpha
+	fillPaint.innerColor.a *= state->alpha;
+	fillPaint.outerColor.a *= state->alpha;
+
+	ctx->params.renderFill(ctx->params.userPtr, &fillPaint, state->compositeOperation, &state->scissor, ctx->fringeWidth,
+						   bounds, &path, 1);
+	if (ctx->record)
+		nvg__recordCall(ctx, NVG_RECORD_FILL, &fillPaint, &state->scissor, 0, bounds, &path, 1, NULL, 0);
+
+	ctx->fillTriCount += path.nfill-2;
+	if (path.nstroke > 0)
+		ctx->fillTriCount += path.nstroke-2;
+	ctx->drawCallCount++;
+}
+
 DLLIMP void nvgStroke(NVGcontext* ctx)
 {
 	NVGstate* state = nvg__getState(ctx);
@@ -2426,6 +2791,8 @@ DLLIMP void nvgStroke(NVGcontext* ctx)
 
 	ctx->params.renderStroke(ctx->params.userPtr, &strokePaint, state->compositeOperation, &state->scissor, ctx->fringeWidth,
 							 strokeWidth, ctx->cache->paths, ctx->cache->npaths);
+	if (ctx->record)
+		nvg__recordCall(ctx, NVG_RECORD_STROKE, &strokePaint, &state->scissor, strokeWidth, ctx->cache->bounds, ctx->cache->paths, ctx->cache->npaths, NULL, 0);
 
 	// Count triangles
 	for (i = 0; i < ctx->cache->npaths; i++) {
@@ -2471,6 +2838,8 @@ DLLIMP char * nvgGetFontName(NVGcontext* ctx, int id)
 DLLIMP int nvgAddFallbackFontId(NVGcontext* ctx, int baseFont, int fallbackFont)
 {
 	if(baseFont == -1 || fallbackFont == -1) return 0;
+	// Glyphs that were missing might now be found.
+	memset(ctx->textCache, 0, sizeof(ctx->textCache));
 	return fonsAddFallbackFont(ctx->fs, baseFont, fallbackFont);
 }
 
@@ -2581,6 +2950,7 @@ static int nvg__allocTextAtlas(NVGcontext* ctx)
 		ctx->fontImages[ctx->fontImageIdx+1] = ctx->params.renderCreateTexture(ctx->params.userPtr, NVG_TEXTURE_ALPHA, iw, ih, 0, NULL);
 	}
 	++ctx->fontImageIdx;
+	++ctx->atlasGen;
 	fonsResetAtlas(ctx->fs, iw, ih);
 	return 1;
 }
@@ -2598,6 +2968,8 @@ static void nvg__renderText(NVGcontext* ctx, NVGvertex* verts, int nverts)
 	paint.outerColor.a *= state->alpha;
 
 	ctx->params.renderTriangles(ctx->params.userPtr, &paint, state->compositeOperation, &state->scissor, verts, nverts, ctx->fringeWidth);
+	if (ctx->record)
+		nvg__recordCall(ctx, NVG_RECORD_TRIANGLES, &paint, &state->scissor, 0, ctx->cache->bounds, NULL, 0, verts, nverts);
 
 	ctx->drawCallCount++;
 	ctx->textTriCount += nverts/3;
@@ -3009,15 +3381,57 @@ DLLIMP int nvgTextFit(NVGcontext* ctx, const char* string, const char* end, floa
 	return rowLen;
 }
 
+// Returns the cache entry of string, moved at the front of its set: width will be < 0 if it was not in the cache.
+static NVGtextWidth* nvg__textCacheEntry(NVGcontext* ctx, const char* string, int len, float fontSize, float letterSpacing)
+{
+	NVGstate* state = nvg__getState(ctx);
+	unsigned long long hash = 14695981039346656037ULL;
+	NVGtextWidth* set;
+	NVGtextWidth entry;
+	int i;
+
+	for (i = 0; i < len; i++)
+		hash = (hash ^ (unsigned char)string[i]) * 1099511628211ULL;
+
+	set = ctx->textCache[hash & (NVG_TEXTCACHE_SETS-1)];
+	for (i = 0; i < NVG_TEXTCACHE_WAYS-1; i++) {
+		if (set[i].hash == hash && set[i].len == len && set[i].fontId == state->fontId &&
+			set[i].fontSize == fontSize && set[i].letterSpacing == letterSpacing) break;
+	}
+	entry = set[i];
+	if (i == NVG_TEXTCACHE_WAYS-1 && !(entry.hash == hash && entry.len == len && entry.fontId == state->fontId &&
+		entry.fontSize == fontSize && entry.letterSpacing == letterSpacing)) {
+		// Not found: evict least recently used.
+		entry.hash = hash;
+		entry.len = len;
+		entry.fontId = state->fontId;
+		entry.fontSize = fontSize;
+		entry.letterSpacing = letterSpacing;
+		entry.width = -1;
+	}
+	memmove(set + 1, set, i * sizeof(NVGtextWidth));
+	set[0] = entry;
+	return set;
+}
+
 DLLIMP float nvgTextBounds(NVGcontext* ctx, float x, float y, const char* string, const char* end, float* bounds)
 {
 	NVGstate* state = nvg__getState(ctx);
 	float scale = nvg__getFontScale(state) * ctx->devicePxRatio;
 	float invscale = 1.0f / scale;
+	NVGtextWidth* cached = NULL;
 	float width;
 
 	if (state->fontId == FONS_INVALID) return 0;
 
+	if (bounds == NULL) {
+		// Only the advance is needed: it does not depend on position or alignment.
+		int len = end ? (int)(end - string) : (int)strlen(string);
+		if (len <= 0) return 0;
+		cached = nvg__textCacheEntry(ctx, string, len, state->fontSize*scale, state->letterSpacing*scale);
+		if (cached->width >= 0) return cached->width * invscale;
+	}
+
 	fonsSetSize(ctx->fs, state->fontSize*scale);
 	fonsSetSpacing(ctx->fs, state->letterSpacing*scale);
 	fonsSetBlur(ctx->fs, state->fontBlur*scale);
@@ -3025,6 +3439,7 @@ DLLIMP float nvgTextBounds(NVGcontext* ctx, float x, float y, const char* string
 	fonsSetFont(ctx->fs, state->fontId);
 
 	width = fonsTextBounds(ctx->fs, x*scale, y*scale, string, end, bounds);
+	if (cached) cached->width = width;
 	if (bounds != NULL) {
 		// Use line bounds for height.
 		fonsLineBounds(ctx->fs, y*scale, &bounds[1], &bounds[3]);
@@ -24,6 +24,10 @@
  * - added nvgTextFit() function: similar to nvgTextBreakLines() but works on character level, not word.
  * - added nvgGetCurTextColor().
  * - added nvgFillColorRGBA8().
+ * - added a cache of text width to nvgTextBounds() (when bounds is NULL).
+ * - added nvgBeginRecord(), nvgEndRecord(), nvgReplay(): retained tessellation output.
+ * - added nvgCurrentScissor().
+ * - added nvgFillRect(): fast path for axis aligned rectangles.
  * - added DLL support and exported stb_image functions.
  * - added possibility to nest nvgBeginFrame and nvgEndFrame.
  * - added ALPHA only back buffer for nvgluCreateFramebuffer().
@@ -202,6 +206,31 @@ DLLIMP void nvgCancelFrame(NVGcontext* ctx);
 // Ends drawing flushing remaining render state.
 DLLIMP void nvgEndFrame(NVGcontext* ctx);
 
+//
+// Records
+//
+// Render calls made between nvgBeginRecord() and nvgEndRecord() are also kept in a record:
+// flattened paths, tessellated vertices, paints and scissors. nvgReplay() sends them again to the
+// renderer, without any path or text processing. x,y is a reference point: replaying a record at
+// a different point will translate its content.
+
+typedef struct NVGrecord NVGrecord;
+
+// Starts recording: <rec> can be a previous record to reuse its memory, or NULL to allocate a new one.
+// Records can be nested: calls (including replayed ones) are kept in all active records.
+DLLIMP NVGrecord* nvgBeginRecord(NVGcontext* ctx, NVGrecord* rec, float x, float y);
+
+// Stops last started record.
+DLLIMP void nvgEndRecord(NVGcontext* ctx);
+
+// Render content of record. Calls that used the scissor active when recording started will use the
+// current one. Returns 0 if record is not usable anymore (font atlas reset, or a scissor set within
+// the record does not match the current one): draw and record again in that case.
+DLLIMP int nvgReplay(NVGcontext* ctx, NVGrecord* rec, float x, float y);
+
+// Free memory used by record.
+DLLIMP void nvgDeleteRecord(NVGrecord* rec);
+
 //
 // Composite operation
 //
@@ -492,6 +521,10 @@ DLLIMP void nvgIntersectScissor(NVGcontext* ctx, float x, float y, float w, floa
 // Reset and disables scissoring.
 DLLIMP void nvgResetScissor(NVGcontext* ctx);
 
+// Returns 0 if scissoring is disabled, otherwise fills bounds with the axis aligned bounding box
+// of current scissor rectangle, in render coordinates: [xmin,ymin, xmax,ymax].
+DLLIMP int nvgCurrentScissor(NVGcontext* ctx, float* bounds);
+
 //
 // Paths
 //
@@ -557,6 +590,11 @@ DLLIMP void nvgCircle(NVGcontext* ctx, float cx, float cy, float r);
 // Fills the current path with current fill style.
 DLLIMP void nvgFill(NVGcontext* ctx);
 
+// Fills an axis aligned rectangle with current fill style, without going through path
+// flattening. Current path is left untouched. Rectangles aligned on pixel boundaries are
+// emitted without anti-aliasing fringe.
+DLLIMP void nvgFillRect(NVGcontext* ctx, float x, float y, float w, float h);
+
 // Fills the current path with current stroke style.
 DLLIMP void nvgStroke(NVGcontext* ctx);
 
@@ -29,6 +29,7 @@ extern "C" {
 #  define NANOVG_GL3 1
 #  define NANOVG_GL_IMPLEMENTATION 1
 #  define NANOVG_GL_USE_UNIFORMBUFFER 1
+#  define NANOVG_GL_USE_RINGBUFFER 1
 #elif defined NANOVG_GLES2_IMPLEMENTATION
 #  define NANOVG_GLES2 1
 #  define NANOVG_GL_IMPLEMENTATION 1
@@ -164,9 +165,16 @@ struct GLNVGcall {
 	int triangleCount;
 	int uniformOffset;
 	GLNVGblend blendFunc;
+	float bounds[4];	// area covered by vertices (union of batch if merged)
+	int batchNext;		// next call drawn with this one, -1 if none
+	int batchLast;
+	int batched;		// drawn by an earlier call: skip
 };
 typedef struct GLNVGcall GLNVGcall;
 
+// Max number of draws a call can be moved before to be merged with a compatible one
+#define GLNVG_BATCH_LOOKBACK 32
+
 struct GLNVGpath {
 	int fillOffset;
 	int fillCount;
@@ -216,6 +224,19 @@ struct GLNVGfragUniforms {
 };
 typedef struct GLNVGfragUniforms GLNVGfragUniforms;
 
+#if NANOVG_GL_USE_RINGBUFFER
+// Streaming buffer: each frame is appended after the previous ones, storage is orphaned when full.
+struct GLNVGring {
+	int size;		// capacity of buffer storage
+	int offset;		// where next upload will start
+	int highWater;	// largest upload seen so far
+};
+typedef struct GLNVGring GLNVGring;
+
+// Number of frames of the largest upload that fit in a ring before orphaning
+#define GLNVG_RING_FRAMES 3
+#endif
+
 struct GLNVGcontext {
 	GLNVGshader shader;
 	GLNVGtexture* textures;
@@ -229,9 +250,15 @@ struct GLNVGcontext {
 #endif
 #if NANOVG_GL_USE_UNIFORMBUFFER
 	GLuint fragBuf;
+#endif
+#if NANOVG_GL_USE_RINGBUFFER
+	GLNVGring vertRing;
+	GLNVGring fragRing;
+	int fragBase;	// offset of current frame uniforms in fragBuf
 #endif
 	int fragSize;
 	int flags;
+	int keepScissor;	// leave GL_SCISSOR_TEST as set by caller (partial redraw)
 
 	// Per frame buffers
 	GLNVGcall* calls;
@@ -243,6 +270,8 @@ struct GLNVGcontext {
 	struct NVGvertex* verts;
 	int cverts;
 	int nverts;
+	struct NVGvertex* packed;	// verts of drawn calls only, when some have been batched
+	int cpacked;
 	unsigned char* uniforms;
 	int cuniforms;
 	int nuniforms;
@@ -260,6 +289,8 @@ struct GLNVGcontext {
 typedef struct GLNVGcontext GLNVGcontext;
 
 static int glnvg__maxi(int a, int b) { return a > b ? a : b; }
+static float glnvg__minf(float a, float b) { return a < b ? a : b; }
+static float glnvg__maxf(float a, float b) { return a > b ? a : b; }
 
 #ifdef NANOVG_GLES2
 static unsigned int glnvg__nearestPow2(unsigned int num)
@@ -989,6 +1020,9 @@ static GLNVGfragUniforms* nvg__fragUniformPtr(GLNVGcontext* gl, int i);
 static void glnvg__setUniforms(GLNVGcontext* gl, int uniformOffset, int image)
 {
 #if NANOVG_GL_USE_UNIFORMBUFFER
+	#if NANOVG_GL_USE_RINGBUFFER
+	uniformOffset += gl->fragBase;
+	#endif
 	glBindBufferRange(GL_UNIFORM_BUFFER, GLNVG_FRAG_BINDING, gl->fragBuf, uniformOffset, sizeof(GLNVGfragUniforms));
 #else
 	GLNVGfragUniforms* frag = nvg__fragUniformPtr(gl, uniformOffset);
@@ -1180,13 +1214,254 @@ static GLNVGblend glnvg__blendCompositeOperation(NVGcompositeOperationState op)
 	return blend;
 }
 
+static void glnvg__boundsAdd(float* bounds, const NVGvertex* verts, int nverts)
+{
+	int i;
+	for (i = 0; i < nverts; i++) {
+		if (bounds[0] > verts[i].x) bounds[0] = verts[i].x;
+		if (bounds[1] > verts[i].y) bounds[1] = verts[i].y;
+		if (bounds[2] < verts[i].x) bounds[2] = verts[i].x;
+		if (bounds[3] < verts[i].y) bounds[3] = verts[i].y;
+	}
+}
+
+static void glnvg__callBounds(GLNVGcontext* gl, GLNVGcall* call)
+{
+	GLNVGpath* paths = &gl->paths[call->pathOffset];
+	int i;
+
+	call->bounds[0] = call->bounds[1] = 1e6f;
+	call->bounds[2] = call->bounds[3] = -1e6f;
+	for (i = 0; i < call->pathCount; i++) {
+		glnvg__boundsAdd(call->bounds, &gl->verts[paths[i].fillOffset], paths[i].fillCount);
+		glnvg__boundsAdd(call->bounds, &gl->verts[paths[i].strokeOffset], paths[i].strokeCount);
+	}
+	glnvg__boundsAdd(call->bounds, &gl->verts[call->triangleOffset], call->triangleCount);
+}
+
+static int glnvg__canBatch(GLNVGcall* call)
+{
+	// Calls using only one uniform block and no stencil
+	return call->type == GLNVG_CONVEXFILL || call->type == GLNVG_TRIANGLES;
+}
+
+static int glnvg__sameState(GLNVGcontext* gl, GLNVGcall* a, GLNVGcall* b)
+{
+	return a->image == b->image &&
+		memcmp(&a->blendFunc, &b->blendFunc, sizeof(GLNVGblend)) == 0 &&
+		memcmp(nvg__fragUniformPtr(gl, a->uniformOffset), nvg__fragUniformPtr(gl, b->uniformOffset), sizeof(GLNVGfragUniforms)) == 0;
+}
+
+static int glnvg__overlap(const float* a, const float* b)
+{
+	return a[0] < b[2] && a[2] > b[0] && a[1] < b[3] && a[3] > b[1];
+}
+
+// Number of vertices needed to draw call as GL_TRIANGLES.
+static int glnvg__triangleCount(GLNVGcontext* gl, GLNVGcall* call)
+{
+	GLNVGpath* paths = &gl->paths[call->pathOffset];
+	int i, count = call->type == GLNVG_TRIANGLES ? call->triangleCount : 0;
+
+	for (i = 0; i < call->pathCount; i++) {
+		if (paths[i].fillCount > 2) count += (paths[i].fillCount - 2) * 3;
+		if (paths[i].strokeCount > 2) count += (paths[i].strokeCount - 2) * 3;
+	}
+	return count;
+}
+
+// Convert fans and strips of call to a triangle list, keeping winding order.
+static NVGvertex* glnvg__triangulate(GLNVGcontext* gl, GLNVGcall* call, NVGvertex* dst)
+{
+	GLNVGpath* paths = &gl->paths[call->pathOffset];
+	int i, j;
+
+	if (call->type == GLNVG_TRIANGLES) {
+		memcpy(dst, &gl->verts[call->triangleOffset], sizeof(NVGvertex) * call->triangleCount);
+		return dst + call->triangleCount;
+	}
+	for (i = 0; i < call->pathCount; i++) {
+		NVGvertex* fan = &gl->verts[paths[i].fillOffset];
+		NVGvertex* strip = &gl->verts[paths[i].strokeOffset];
+		for (j = 2; j < paths[i].fillCount; j++) {
+			dst[0] = fan[0];
+			dst[1] = fan[j-1];
+			dst[2] = fan[j];
+			dst += 3;
+		}
+		for (j = 2; j < paths[i].strokeCount; j++) {
+			dst[0] = strip[j & 1 ? j-1 : j-2];
+			dst[1] = strip[j & 1 ? j-2 : j-1];
+			dst[2] = strip[j];
+			dst += 3;
+		}
+	}
+	return dst;
+}
+
+// Number of vertices used by call as it is.
+static int glnvg__callVertCount(GLNVGcontext* gl, GLNVGcall* call)
+{
+	GLNVGpath* paths = &gl->paths[call->pathOffset];
+	int i, count = call->triangleCount;
+
+	for (i = 0; i < call->pathCount; i++)
+		count += paths[i].fillCount + paths[i].strokeCount;
+	return count;
+}
+
+// Copy the ranges of vertices used by call at dst, returns end of copy.
+static NVGvertex* glnvg__copyVerts(GLNVGcontext* gl, GLNVGcall* call, NVGvertex* base, NVGvertex* dst)
+{
+	GLNVGpath* paths = &gl->paths[call->pathOffset];
+	int i;
+
+	for (i = 0; i < call->pathCount; i++) {
+		memcpy(dst, &gl->verts[paths[i].fillOffset], sizeof(NVGvertex) * paths[i].fillCount);
+		paths[i].fillOffset = (int)(dst - base);
+		dst += paths[i].fillCount;
+		memcpy(dst, &gl->verts[paths[i].strokeOffset], sizeof(NVGvertex) * paths[i].strokeCount);
+		paths[i].strokeOffset = (int)(dst - base);
+		dst += paths[i].strokeCount;
+	}
+	memcpy(dst, &gl->verts[call->triangleOffset], sizeof(NVGvertex) * call->triangleCount);
+	call->triangleOffset = (int)(dst - base);
+	return dst + call->triangleCount;
+}
+
+// Rebuild vertex array with only what will be drawn: merged calls become one triangle list (head of
+// batch turned into a GLNVG_TRIANGLES call), fans and strips they were made of are not uploaded.
+static void glnvg__packVerts(GLNVGcontext* gl)
+{
+	NVGvertex* dst;
+	NVGvertex* swap;
+	int i, j, count;
+
+	for (i = count = 0; i < gl->ncalls; i++) {
+		GLNVGcall* call = &gl->calls[i];
+		if (call->batched) continue;
+		if (call->batchNext < 0)
+			count += glnvg__callVertCount(gl, call);
+		else for (j = i; j >= 0; j = gl->calls[j].batchNext)
+			count += glnvg__triangleCount(gl, &gl->calls[j]);
+	}
+
+	if (count > gl->cpacked) {
+		int cpacked = glnvg__maxi(count, gl->cverts);
+		NVGvertex* packed = (NVGvertex*)realloc(gl->packed, sizeof(NVGvertex) * cpacked);
+		if (packed == NULL) {
+			// Out of memory: draw them one by one
+			for (i = 0; i < gl->ncalls; i++)
+				gl->calls[i].batched = 0;
+			return;
+		}
+		gl->packed = packed;
+		gl->cpacked = cpacked;
+	}
+
+	for (i = 0, dst = gl->packed; i < gl->ncalls; i++) {
+		GLNVGcall* call = &gl->calls[i];
+		NVGvertex* start = dst;
+		if (call->batched) continue;
+		if (call->batchNext < 0) {
+			dst = glnvg__copyVerts(gl, call, gl->packed, dst);
+			continue;
+		}
+		for (j = i; j >= 0; j = gl->calls[j].batchNext)
+			dst = glnvg__triangulate(gl, &gl->calls[j], dst);
+
+		call->type = GLNVG_TRIANGLES;
+		call->pathCount = 0;
+		call->triangleOffset = (int)(start - gl->packed);
+		call->triangleCount = (int)(dst - start);
+	}
+
+	// Keep both buffers around: they will be reused next frame
+	swap = gl->verts; gl->verts = gl->packed; gl->packed = swap;
+	i = gl->cverts; gl->cverts = gl->cpacked; gl->cpacked = i;
+	gl->nverts = count;
+}
+
+// Merge convex fills and triangles sharing image, blend and uniforms into one GL_TRIANGLES
+// draw. A call can be moved before earlier draws as long as it does not overlap them.
+static void glnvg__batchCalls(GLNVGcontext* gl)
+{
+	int i, j, n, merged = 0;
+
+	for (i = 0; i < gl->ncalls; i++) {
+		GLNVGcall* call = &gl->calls[i];
+		call->batchNext = -1;
+		call->batchLast = i;
+		call->batched = 0;
+		glnvg__callBounds(gl, call);
+		if (!glnvg__canBatch(call)) continue;
+
+		for (j = i-1, n = 0; j >= 0 && n < GLNVG_BATCH_LOOKBACK; j--) {
+			GLNVGcall* prev = &gl->calls[j];
+			if (prev->batched) continue;
+			if (glnvg__canBatch(prev) && glnvg__sameState(gl, prev, call)) {
+				gl->calls[prev->batchLast].batchNext = i;
+				prev->batchLast = i;
+				prev->bounds[0] = glnvg__minf(prev->bounds[0], call->bounds[0]);
+				prev->bounds[1] = glnvg__minf(prev->bounds[1], call->bounds[1]);
+				prev->bounds[2] = glnvg__maxf(prev->bounds[2], call->bounds[2]);
+				prev->bounds[3] = glnvg__maxf(prev->bounds[3], call->bounds[3]);
+				call->batched = 1;
+				merged = 1;
+				break;
+			}
+			if (glnvg__overlap(prev->bounds, call->bounds)) break;
+			n++;
+		}
+	}
+
+	if (merged)
+		glnvg__packVerts(gl);
+}
+
+#if NANOVG_GL_USE_RINGBUFFER
+// Copy data in buffer bound to target without waiting for the GPU to be done with previous
+// frames. Returns offset where it has been written.
+static int glnvg__ringUpload(GLNVGring* ring, GLenum target, const void* data, int size, int align)
+{
+	int offset = (ring->offset + align - 1) / align * align;
+	void* ptr;
+
+	if (size == 0)
+		return offset;
+	if (ring->highWater < size)
+		ring->highWater = size;
+
+	if (offset + size > ring->size) {
+		// Orphan current storage: driver keeps it alive until pending draws are done with it.
+		ring->size = ring->highWater * GLNVG_RING_FRAMES;
+		glBufferData(target, ring->size, NULL, GL_STREAM_DRAW);
+		offset = 0;
+	}
+
+	// Range has not been used since storage was allocated: no need to sync
+	ptr = glMapBufferRange(target, offset, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (ptr != NULL) {
+		memcpy(ptr, data, size);
+		glUnmapBuffer(target);
+	} else {
+		glBufferSubData(target, offset, size, data);
+	}
+	ring->offset = offset + size;
+	return offset;
+}
+#endif
+
 static void glnvg__renderFlush(void* uptr)
 {
 	GLNVGcontext* gl = (GLNVGcontext*)uptr;
+	size_t vertBase = 0;
 	int i;
 
 	if (gl->ncalls > 0) {
 
+		glnvg__batchCalls(gl);
+
 		// Setup require GL state.
 		glUseProgram(gl->shader.prog);
 
@@ -1195,7 +1470,8 @@ static void glnvg__renderFlush(void* uptr)
 		glFrontFace(GL_CCW);
 		glEnable(GL_BLEND);
 		glDisable(GL_DEPTH_TEST);
-		glDisable(GL_SCISSOR_TEST);
+		if (!gl->keepScissor)
+			glDisable(GL_SCISSOR_TEST);
 		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
 		glStencilMask(0xffffffff);
 		glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
@@ -1214,6 +1490,16 @@ static void glnvg__renderFlush(void* uptr)
 		gl->blendFunc.dstAlpha = GL_INVALID_ENUM;
 		#endif
 
+#if NANOVG_GL_USE_RINGBUFFER
+		// Upload ubo for frag shaders (fragSize is a multiple of required offset alignment)
+		glBindBuffer(GL_UNIFORM_BUFFER, gl->fragBuf);
+		gl->fragBase = glnvg__ringUpload(&gl->fragRing, GL_UNIFORM_BUFFER, gl->uniforms, gl->nuniforms * gl->fragSize, gl->fragSize);
+
+		// Upload vertex data
+		glBindVertexArray(gl->vertArr);
+		glBindBuffer(GL_ARRAY_BUFFER, gl->vertBuf);
+		vertBase = glnvg__ringUpload(&gl->vertRing, GL_ARRAY_BUFFER, gl->verts, gl->nverts * sizeof(NVGvertex), sizeof(NVGvertex));
+#else
 #if NANOVG_GL_USE_UNIFORMBUFFER
 		// Upload ubo for frag shaders
 		glBindBuffer(GL_UNIFORM_BUFFER, gl->fragBuf);
@@ -1226,10 +1512,11 @@ static void glnvg__renderFlush(void* uptr)
 #endif
 		glBindBuffer(GL_ARRAY_BUFFER, gl->vertBuf);
 		glBufferData(GL_ARRAY_BUFFER, gl->nverts * sizeof(NVGvertex), gl->verts, GL_STREAM_DRAW);
+#endif
 		glEnableVertexAttribArray(0);
 		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(NVGvertex), (const GLvoid*)(size_t)0);
-		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(NVGvertex), (const GLvoid*)(0 + 2*sizeof(float)));
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(NVGvertex), (const GLvoid*)(size_t)vertBase);
+		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(NVGvertex), (const GLvoid*)(vertBase + 2*sizeof(float)));
 
 		// Set view and texture just once per frame.
 		glUniform1i(gl->shader.loc[GLNVG_LOC_TEX], 0);
@@ -1241,6 +1528,7 @@ static void glnvg__renderFlush(void* uptr)
 
 		for (i = 0; i < gl->ncalls; i++) {
 			GLNVGcall* call = &gl->calls[i];
+			if (call->batched) continue;
 			glnvg__blendFuncSeparate(gl,&call->blendFunc);
 			if (call->type == GLNVG_FILL)
 				glnvg__fill(gl, call);
@@ -1557,6 +1845,7 @@ static void glnvg__renderDelete(void* uptr)
 
 	free(gl->paths);
 	free(gl->verts);
+	free(gl->packed);
 	free(gl->uniforms);
 	free(gl->calls);
 
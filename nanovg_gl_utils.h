@@ -32,6 +32,9 @@ DLLIMP void nvgluBindFramebuffer(NVGLUframebuffer* fb);
 DLLIMP NVGLUframebuffer* nvgluCreateFramebuffer(NVGcontext* ctx, int w, int h, int imageFlags);
 DLLIMP void nvgluDeleteFramebuffer(NVGLUframebuffer* fb);
 
+// Keep the GL scissor test set by the caller enabled while flushing (clip a whole frame).
+DLLIMP void nvgluKeepScissor(NVGcontext* ctx, int keep);
+
 #endif // NANOVG_GL_UTILS_H
 
 #ifdef NANOVG_GL_IMPLEMENTATION
@@ -163,4 +166,10 @@ void nvgluDeleteFramebuffer(NVGLUframebuffer* fb)
 #endif
 }
 
+void nvgluKeepScissor(NVGcontext* ctx, int keep)
+{
+	GLNVGcontext* gl = (GLNVGcontext*)nvgInternalParams(ctx)->userPtr;
+	gl->keepScissor = keep;
+}
+
 #endif // NANOVG_GL_IMPLEMENTATION